@@ -1,14 +1,55 @@
 // Copyright (c) 2023 Weidong Fang (wdfang@gmail.com)
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <functional>
 #include <istream>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <ostream>
+#include <queue>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define JSRW_POSIX 1
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define JSRW_COROUTINES 1
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define JSRW_VERSION "0.2.0"
 
 namespace jsrw {
@@ -20,490 +61,3105 @@ enum TokenType {
     Integer,
     Number,
     String,
+    Partial,  // more input is needed to complete a token
     Error = 400,
 };
 
-template <size_t BUFF = 4096>
-class Reader {
-   private:
-    std::istream *input_;
-    char buff_[BUFF];
-    const char *data_;
-    size_t size_;
-    int current_;
+// Tag for readers that parse a mutable buffer in situ.
+struct insitu_t {};
+inline constexpr insitu_t insitu{};
 
-    inline int read() {
-        if (size_ == 0 && input_) {
-            input_->read(buff_, BUFF);
-            data_ = buff_;
-            size_ = input_->gcount();
-        }
-        if (size_ == 0) {
-            return (current_ = Empty);
-        }
-        size_--;
-        return (current_ = *data_++);
+// Character classes, independent of the global locale.
+enum CharClass : uint8_t {
+    CharSpace = 1,    // JSON whitespace
+    CharDigit = 2,    // 0-9
+    CharNumber = 4,   // characters that may appear in a number
+    CharSpecial = 8,  // characters that end a run of plain string characters
+    CharNested = 16,  // quotes and brackets, which delimit nested values
+};
+
+constexpr std::array<uint8_t, 256> make_char_classes() {
+    std::array<uint8_t, 256> table{};
+    for (int c = 0; c < 0x20; c++) {
+        table[c] |= CharSpecial;
+    }
+    table['"'] |= CharSpecial;
+    table['\\'] |= CharSpecial;
+    for (char c : {' ', '\t', '\n', '\r'}) {
+        table[c] |= CharSpace;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+        table[c] |= CharDigit | CharNumber;
     }
+    for (char c : {'-', '+', '.', 'e', 'E'}) {
+        table[c] |= CharNumber;
+    }
+    for (char c : {'"', '{', '}', '[', ']'}) {
+        table[c] |= CharNested;
+    }
+    return table;
+}
 
-    struct Token {
-        int type;
-        union {
-            bool bval;
-            long lval;
-            double dval;
-        };
-    };
+inline constexpr std::array<uint8_t, 256> char_classes = make_char_classes();
 
-    Token next_;
-    std::string key_;
+// Tests a character, or a token type such as Empty, against a character class.
+constexpr bool is_class(int c, CharClass cls) { return (unsigned)c < 256 && (char_classes[c] & cls); }
 
-    void parse() {
-        skip_space();
+// Returns the first non-whitespace character in [p, end), or end.
+inline const char *find_non_space(const char *p, const char *end) {
+    if (p < end && !(char_classes[(unsigned char)*p] & CharSpace)) {
+        return p;
+    }
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+        if (uint32_t mask = ~_mm_movemask_epi8(m) & 0xffff) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (p < end && (char_classes[(unsigned char)*p] & CharSpace)) {
+        p++;
+    }
+    return p;
+}
 
-        if (current_ == Empty) {
-            next_.type = Empty;
-            return;
+// Returns the first quote, backslash or control character in [p, end), or end. With Slash,
+// slashes are found too.
+template <bool Slash = false>
+inline const char *find_string_special(const char *p, const char *end) {
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                                    _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control));
+        if constexpr (Slash) {
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+        }
+        if (uint32_t mask = _mm256_movemask_epi8(m)) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i quote16 = _mm_set1_epi8('"');
+    const __m128i backslash16 = _mm_set1_epi8('\\');
+    const __m128i control16 = _mm_set1_epi8(0x1f);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote16), _mm_cmpeq_epi8(v, backslash16)),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(v, control16), control16));
+        if constexpr (Slash) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
         }
+        if (uint32_t mask = _mm_movemask_epi8(m)) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (p < end && !(char_classes[(unsigned char)*p] & CharSpecial) && (!Slash || *p != '/')) {
+        p++;
+    }
+    return p;
+}
 
-        switch (current_) {
-            case '{':
-            case '}':
-            case '[':
-            case ']':
-            case ':':
-            case ',':
-                next_.type = current_;
-                read();
-                break;
+// Returns the first quote or bracket in [p, end), or end. With Commas, commas are found too.
+template <bool Commas = false>
+inline const char *find_nested(const char *p, const char *end) {
+    // '[' and ']' differ from '{' and '}' only in bit 0x20.
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b = _mm256_or_si256(v, bit);
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(b, open), _mm256_cmpeq_epi8(b, close)));
+        if constexpr (Commas) {
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, comma));
+        }
+        if (uint32_t mask = _mm256_movemask_epi8(m)) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i quote16 = _mm_set1_epi8('"');
+    const __m128i comma16 = _mm_set1_epi8(',');
+    const __m128i bit16 = _mm_set1_epi8(0x20);
+    const __m128i open16 = _mm_set1_epi8('{');
+    const __m128i close16 = _mm_set1_epi8('}');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_or_si128(v, bit16);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote16),
+                                 _mm_or_si128(_mm_cmpeq_epi8(b, open16), _mm_cmpeq_epi8(b, close16)));
+        if constexpr (Commas) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, comma16));
+        }
+        if (uint32_t mask = _mm_movemask_epi8(m)) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (p < end && !(char_classes[(unsigned char)*p] & CharNested) && (!Commas || *p != ',')) {
+        p++;
+    }
+    return p;
+}
+
+// Finds the elements of the array whose contents start at p, outside strings and nested values,
+// using find_nested() and find_string_special(). Appends the start of each element to starts and
+// returns the closing bracket, or nullptr if the array is not terminated or has a bad string.
+inline const char *find_elements(const char *p, const char *end, std::vector<const char *> &starts) {
+    starts.push_back(p);
+    int depth = 1;
+    while ((p = find_nested<true>(p, end)) < end) {
+        switch (*p++) {
             case '"':
-                next_.type = String;
-                break;
-            case 'n':
-                if (read() == 'u' && read() == 'l' && read() == 'l') {
-                    next_.type = Null;
-                    read();
-                } else {
-                    next_.type = Error;
+                for (;;) {
+                    p = find_string_special(p, end);
+                    if (p == end || (unsigned char)*p < 0x20) {
+                        return nullptr;
+                    }
+                    if (*p++ == '"') {
+                        break;
+                    }
+                    if (p++ == end) {
+                        return nullptr;
+                    }
                 }
                 break;
-            case 't':
-                if (read() == 'r' && read() == 'u' && read() == 'e') {
-                    next_.bval = true;
-                    next_.type = Bool;
-                    read();
-                } else {
-                    next_.type = Error;
-                }
+            case '{':
+            case '[':
+                depth++;
                 break;
-            case 'f':
-                if (read() == 'a' && read() == 'l' && read() == 's' && read() == 'e') {
-                    next_.bval = false;
-                    next_.type = Bool;
-                    read();
-                } else {
-                    next_.type = Error;
+            case '}':
+            case ']':
+                if (--depth == 0) {
+                    return p - 1;
                 }
                 break;
-            default:
-                next_.type = parse_num(next_);
+            case ',':
+                if (depth == 1) {
+                    starts.push_back(p);
+                }
                 break;
         }
     }
+    return nullptr;
+}
 
-    void skip_space() {
-        while (isspace(current_)) {
-            read();
+// A scanned token. Integers are kept as a sign and a 64-bit magnitude.
+struct Token {
+    int type;
+    bool neg;  // sign of an Integer, whose magnitude is in uval
+    union {
+        bool bval;
+        uint64_t uval;
+        double dval;
+    };
+    std::string_view text;  // contents of a String scanned by a Tokenizer, or the text of a number
+
+    bool get(bool &value) const {
+        if (type == Bool) {
+            value = bval;
+            return true;
         }
+        return false;
     }
 
-    void skip_string() {
-        while (current_ != Empty) {
-            read();
-            if (current_ == '"') {
-                read();
-                break;
-            } else if (current_ == '\\') {
-                read();
+    // Converts an integer exactly; fails if it is out of the range of Type.
+    template <typename Type, std::enable_if_t<std::is_integral<Type>::value, bool> = true>
+    bool get(Type &value) const {
+        if (type != Integer) {
+            return false;
+        }
+        uint64_t max = std::numeric_limits<Type>::max();
+        if (neg) {
+            max = std::is_signed<Type>::value ? max + 1 : 0;
+        }
+        if (uval > max) {
+            return false;
+        }
+        value = neg ? (Type)(0 - uval) : (Type)uval;
+        return true;
+    }
+
+    template <typename Type, std::enable_if_t<std::is_floating_point<Type>::value, bool> = true>
+    bool get(Type &value) const {
+        if (type == Number) {
+            value = dval;
+            return true;
+        } else if (type == Integer) {
+            value = neg ? -(Type)uval : (Type)uval;
+            return true;
+        }
+        return false;
+    }
+
+    template <class Traits, class Alloc>
+    bool get(std::basic_string<char, Traits, Alloc> &value) const {
+        if (type == String) {
+            value.assign(text.data(), text.size());
+            return true;
+        }
+        return false;
+    }
+
+    bool get(std::string_view &value) const {
+        if (type == String) {
+            value = text;
+            return true;
+        }
+        return false;
+    }
+};
+
+inline int32_t encode_utf8(int32_t ch, char *buffer) {
+    if (ch <= 0x7f) {
+        buffer[0] = (char)ch;
+        return 1;
+    }
+
+    if (ch <= 0x7ff) {
+        buffer[0] = (char)(0xc0 | (ch >> 6));
+        buffer[1] = (char)(0x80 | (ch & 0x03f));
+        return 2;
+    }
+
+    if (ch <= 0xffff) {
+        buffer[0] = (char)(0xe0 | (ch >> 12));
+        buffer[1] = (char)(0x80 | ((ch >> 6) & 0x3f));
+        buffer[2] = (char)(0x80 | (ch & 0x3f));
+        return 3;
+    }
+
+    if (ch <= 0x10ffff) {
+        buffer[0] = (char)(0xf0 | (ch >> 18));
+        buffer[1] = (char)(0x80 | ((ch >> 12) & 0x3f));
+        buffer[2] = (char)(0x80 | ((ch >> 6) & 0x3f));
+        buffer[3] = (char)(0x80 | (ch & 0x3f));
+        return 4;
+    }
+
+    return -1;
+}
+
+inline bool is_digit(int c) { return is_class(c, CharDigit); }
+
+inline bool is_number_char(int c) { return is_class(c, CharNumber); }
+
+// Converts eight ASCII digits at p at once, or returns false if they are not all digits.
+inline bool parse_eight_digits(const char *p, uint64_t &val) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    memcpy(&v, p, 8);
+    if (((v & 0xf0f0f0f0f0f0f0f0) | (((v + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) >> 4)) !=
+        0x3333333333333333) {
+        return false;
+    }
+    v = (v & 0x0f0f0f0f0f0f0f0f) * 2561 >> 8;
+    v = (v & 0x00ff00ff00ff00ff) * 6553601 >> 16;
+    val = (v & 0x0000ffff0000ffff) * 42949672960001 >> 32;
+    return true;
+#else
+    (void)p;
+    (void)val;
+    return false;
+#endif
+}
+
+// Accumulates the digits at p into val, eight at a time while the buffer allows. Sets
+// overflow if the value does not fit in 64 bits.
+inline const char *parse_digits(const char *p, const char *end, uint64_t &val, bool &overflow) {
+    uint64_t v8;
+    while (end - p >= 8 && parse_eight_digits(p, v8)) {
+        if (val > (UINT64_MAX - v8) / 100000000) {
+            overflow = true;
+        }
+        val = val * 100000000 + v8;
+        p += 8;
+    }
+    while (p < end && is_digit(*p)) {
+        uint64_t d = *p++ - '0';
+        if (val > (UINT64_MAX - d) / 10) {
+            overflow = true;
+        }
+        val = val * 10 + d;
+    }
+    return p;
+}
+
+// Converts the number in [p, end) in one pass. Doubles are correctly rounded by
+// std::from_chars; exponents out of the range of double yield an Error on overflow and zero
+// on underflow instead of being applied digit by digit.
+inline int to_number(const char *p, const char *end, Token &val) {
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = *p++ == '-';
+    }
+
+    const char *begin = p;
+    uint64_t uval = 0;
+    bool overflow = false;
+    p = parse_digits(p, end, uval, overflow);
+    size_t digits = p - begin;
+
+    // Decimal position of the first significant digit, used to tell overflow from underflow.
+    const char *q = begin;
+    while (q < p && *q == '0') {
+        q++;
+    }
+    long magnitude = p - q;
+
+    bool is_float = false;
+
+    if (p < end && *p == '.') {
+        const char *frac = ++p;
+        while (p < end && is_digit(*p)) {
+            p++;
+        }
+        if (magnitude == 0) {
+            for (q = frac; q < p && *q == '0'; q++) {
+                magnitude--;
             }
         }
+        digits += p - frac;
+        is_float = true;
     }
 
-    int parse_hex(std::string &s) {
-        char data[4];
-        data[0] = read();
-        data[1] = read();
-        data[2] = read();
-        data[3] = read();
-        int cp = 0;
-        for (int i = 0; i < 4; i++) {
-            char c = data[i];
-            cp *= 16;
-            if (c >= '0' && c <= '9')
-                cp += c - '0';
-            else if (c >= 'a' && c <= 'f')
-                cp += c - 'a' + 10;
-            else if (c >= 'A' && c <= 'F')
-                cp += c - 'A' + 10;
-            else
-                return Error;
+    if (digits == 0) {
+        return Error;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool neg_exp = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            neg_exp = *p++ == '-';
         }
-        int n = encode_utf8(cp, data);
-        for (int i = 0; i < n; i++) {
-            s.push_back(data[i]);
+        const char *exp = p;
+        long e = 0;
+        while (p < end && is_digit(*p)) {
+            if (e < 1000000) {
+                e = e * 10 + (*p - '0');
+            }
+            p++;
+        }
+        if (p == exp) {
+            return Error;
+        }
+        magnitude += neg_exp ? -e : e;
+        is_float = true;
+    }
+
+    if (p != end) {
+        return Error;
+    }
+
+    // Integers beyond 64 bits are kept as doubles, so integral reads of them fail.
+    if (!is_float && !overflow) {
+        val.neg = neg;
+        val.uval = uval;
+        return Integer;
+    }
+
+    double dval;
+    auto result = std::from_chars(begin, end, dval);
+    if (result.ec == std::errc::result_out_of_range) {
+        if (magnitude > 0) {
+            return Error;
+        }
+        dval = 0;
+    } else if (result.ec != std::errc() || result.ptr != end) {
+        return Error;
+    }
+
+    val.dval = neg ? -dval : dval;
+
+    return Number;
+}
+
+// Options for parsing on a pool of threads.
+struct ParallelOptions {
+    unsigned threads = 0;         // worker threads, 0 for one per hardware thread
+    size_t chunk_size = 1 << 20;  // bytes of input per task
+    bool ordered = true;          // deliver results in input order
+};
+
+inline unsigned parallel_threads(const ParallelOptions &options, size_t tasks) {
+    size_t threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+    return (unsigned)std::max<size_t>(1, std::min(threads, tasks));
+}
+
+// Runs fn(task) for every task in [0, tasks) on the calling thread and threads - 1 others.
+template <class Fn>
+void parallel_for(size_t tasks, unsigned threads, Fn &&fn) {
+    std::atomic<size_t> next{0};
+    auto work = [&] {
+        for (size_t i; (i = next++) < tasks;) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto &thread : pool) {
+        thread.join();
+    }
+}
+
+// Input sources. A source supplies the next block of input to a reader:
+//
+//     size_t fill(char *buff, size_t size, const char *&data);
+//
+// It either copies up to size bytes into buff or points data at its own storage, and returns
+// the number of bytes available at data, or 0 at the end of input. A default constructed source
+// is empty. A source declaring `static constexpr bool contiguous = true` delivers all its input
+// in a single block that stays valid for the lifetime of the reader.
+
+struct StreamSource {
+    std::istream *input = nullptr;
+
+    size_t fill(char *buff, size_t size, const char *&data) {
+        if (!input) {
+            return 0;
+        }
+        input->read(buff, size);
+        data = buff;
+        return input->gcount();
+    }
+};
+
+struct FileSource {
+    FILE *file = nullptr;
+
+    size_t fill(char *buff, size_t size, const char *&data) {
+        if (!file) {
+            return 0;
+        }
+        data = buff;
+        return fread(buff, 1, size, file);
+    }
+};
+
+struct MemorySource {
+    static constexpr bool contiguous = true;
+
+    const char *data = nullptr;
+    size_t size = 0;
+
+    size_t fill(char *, size_t, const char *&block) {
+        block = data;
+        size_t n = size;
+        size = 0;
+        return n;
+    }
+};
+
+#ifdef JSRW_POSIX
+struct FdSource {
+    int fd = -1;
+
+    size_t fill(char *buff, size_t size, const char *&data) {
+        if (fd < 0) {
+            return 0;
+        }
+        ssize_t n;
+        do {
+            n = ::read(fd, buff, size);
+        } while (n < 0 && errno == EINTR);
+        data = buff;
+        return n > 0 ? n : 0;
+    }
+};
+
+// Maps a whole file into memory and delivers it as a single contiguous block, so the reader
+// parses straight from the mapping without copying it into its buffer.
+class MappedFile {
+   private:
+    char *map_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+    bool done_ = false;
+
+   public:
+    static constexpr bool contiguous = true;
+
+    MappedFile() = default;
+
+    explicit MappedFile(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            size_ = st.st_size;
+            if (size_ == 0) {
+                open_ = true;
+            } else {
+                void *map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map != MAP_FAILED) {
+                    madvise(map, size_, MADV_SEQUENTIAL);
+                    map_ = (char *)map;
+                    open_ = true;
+                }
+            }
+        }
+        close(fd);
+        if (!open_) {
+            size_ = 0;
+        }
+    }
+
+    explicit MappedFile(const std::string &path) : MappedFile(path.c_str()) {}
+
+    MappedFile(MappedFile &&other) noexcept
+        : map_(other.map_), size_(other.size_), open_(other.open_), done_(other.done_) {
+        other.map_ = nullptr;
+        other.size_ = 0;
+        other.open_ = false;
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        std::swap(map_, other.map_);
+        std::swap(size_, other.size_);
+        std::swap(open_, other.open_);
+        std::swap(done_, other.done_);
+        return *this;
+    }
+
+    ~MappedFile() {
+        if (map_) {
+            munmap(map_, size_);
+        }
+    }
+
+    bool is_open() const { return open_; }
+    const char *data() const { return map_; }
+    size_t size() const { return size_; }
+
+    size_t fill(char *, size_t, const char *&block) {
+        if (done_) {
+            return 0;
+        }
+        done_ = true;
+        block = map_;
+        return size_;
+    }
+};
+#endif
+
+inline void duplicate_key_in_key_set() {}
+
+// A fixed set of object keys with a perfect hash table built at compile time:
+//
+//     static constexpr auto keys = jsrw::make_keys("id", "name", "items");
+//     reader.read(keys, [&](size_t field) {
+//         switch (field) {
+//             case 0: return reader.read(order.id);
+//             ...
+//             default: return reader.skip_value();
+//         }
+//     });
+//
+// Keys are hashed once and placed with per-bucket displacements (hash and displace), so a lookup
+// is one hash, two table reads and one comparison.
+template <size_t N>
+class KeySet {
+    static_assert(N > 0, "empty key set");
+
+   public:
+    static constexpr size_t npos = N;
+
+   private:
+    static constexpr size_t table_size_ = [] {
+        size_t n = 4;
+        while (n < 4 * N) {
+            n *= 2;
+        }
+        return n;
+    }();
+    static constexpr size_t buckets_ = N / 2 + 1;
+
+    std::string_view keys_[N] = {};
+    uint64_t seed_ = 0;
+    uint32_t disp_[buckets_] = {};
+    uint16_t slots_[table_size_] = {};
+
+    static constexpr uint64_t hash(std::string_view key, uint64_t seed) {
+        uint64_t h = 14695981039346656037ull ^ seed;
+        for (char c : key) {
+            h = (h ^ (unsigned char)c) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    static constexpr size_t bucket_of(uint64_t h) { return ((h * 0x9e3779b97f4a7c15ull) >> 40) % buckets_; }
+
+    static constexpr size_t slot_of(uint64_t h, uint32_t d) {
+        return ((uint32_t)h + d * ((uint32_t)(h >> 32) | 1)) & (table_size_ - 1);
+    }
+
+    constexpr bool build(uint64_t seed) {
+        seed_ = seed;
+        for (auto &slot : slots_) {
+            slot = N;
+        }
+        uint64_t hashes[N] = {};
+        size_t bucket[N] = {};
+        size_t count[buckets_] = {};
+        for (size_t i = 0; i < N; i++) {
+            hashes[i] = hash(keys_[i], seed);
+            bucket[i] = bucket_of(hashes[i]);
+            count[bucket[i]]++;
+        }
+        // Place the largest buckets first.
+        for (size_t size = N; size > 0; size--) {
+            for (size_t b = 0; b < buckets_; b++) {
+                if (count[b] != size) {
+                    continue;
+                }
+                bool placed = false;
+                for (uint32_t d = 0; d < 4 * table_size_ && !placed; d++) {
+                    placed = true;
+                    for (size_t i = 0; i < N && placed; i++) {
+                        if (bucket[i] != b) {
+                            continue;
+                        }
+                        size_t slot = slot_of(hashes[i], d);
+                        if (slots_[slot] != N) {
+                            placed = false;
+                            for (size_t j = 0; j < i; j++) {
+                                if (bucket[j] == b) {
+                                    slots_[slot_of(hashes[j], d)] = N;
+                                }
+                            }
+                        } else {
+                            slots_[slot] = i;
+                        }
+                    }
+                    if (placed) {
+                        disp_[b] = d;
+                    }
+                }
+                if (!placed) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+   public:
+    constexpr KeySet(const std::array<std::string_view, N> &keys) {
+        for (size_t i = 0; i < N; i++) {
+            keys_[i] = keys[i];
+        }
+        for (uint64_t seed = 0; !build(seed); seed++) {
+            if (seed == 64) {
+                // Fails constant evaluation.
+                duplicate_key_in_key_set();
+                break;
+            }
+        }
+    }
+
+    constexpr size_t size() const { return N; }
+    constexpr std::string_view operator[](size_t i) const { return keys_[i]; }
+
+    // Returns the index of key in the set, or npos.
+    constexpr size_t find(std::string_view key) const {
+        uint64_t h = hash(key, seed_);
+        size_t i = slots_[slot_of(h, disp_[bucket_of(h)])];
+        return i < N && keys_[i] == key ? i : npos;
+    }
+};
+
+template <class... Keys>
+constexpr KeySet<sizeof...(Keys)> make_keys(const Keys &...keys) {
+    return KeySet<sizeof...(Keys)>({std::string_view(keys)...});
+}
+
+// Field tables generated by JSRW_FIELDS: the keys of a struct and pointers to its members.
+template <class M>
+struct Field {
+    std::string_view name;
+    M member;
+};
+
+template <class M>
+constexpr Field<M> field(std::string_view name, M member) {
+    return {name, member};
+}
+
+template <class... Ms>
+struct Fields {
+    KeySet<sizeof...(Ms)> keys;
+    std::tuple<Ms...> members;
+};
+
+template <class... Ms>
+constexpr Fields<Ms...> make_fields(const Field<Ms> &...fields) {
+    return {KeySet<sizeof...(Ms)>({fields.name...}), std::tuple<Ms...>(fields.member...)};
+}
+
+// Whether T has a field table, found by argument-dependent lookup of jsrw_fields(const T *).
+template <class T, class = void>
+struct has_fields : std::false_type {};
+
+template <class T>
+struct has_fields<T, std::void_t<decltype(jsrw_fields(std::declval<const T *>()))>> : std::true_type {};
+
+template <class Source, class = void>
+struct is_source : std::false_type {};
+
+template <class Source>
+struct is_source<Source, std::void_t<decltype(std::declval<Source &>().fill(
+                             std::declval<char *>(), size_t(), std::declval<const char *&>()))>> : std::true_type {};
+
+template <class Source, class = void>
+struct is_contiguous : std::false_type {};
+
+template <class Source>
+struct is_contiguous<Source, std::void_t<decltype(Source::contiguous)>> : std::bool_constant<Source::contiguous> {};
+
+template <class T>
+struct identity {
+    using type = T;
+};
+
+template <size_t BUFF = 4096, class Source = StreamSource>
+class Reader {
+   private:
+    Source source_;
+    char buff_[BUFF];
+    const char *data_;
+    size_t size_;
+    int current_;
+    bool insitu_ = false;
+    // Whether data_ holds all the remaining input and stays valid while the reader is used.
+    bool stable_ = is_contiguous<Source>::value;
+
+    inline int read() {
+        if (size_ == 0) {
+            size_ = source_.fill(buff_, BUFF, data_);
+        }
+        if (size_ == 0) {
+            return (current_ = Empty);
+        }
+        size_--;
+        return (current_ = *data_++);
+    }
+
+    Token next_;
+    std::string key_;
+    std::string scratch_;
+    std::string num_;
+    std::pmr::memory_resource *resource_ = nullptr;
+
+    // Writes unescaped string data back into the source buffer.
+    struct InSitu {
+        char *p;
+        void push_back(char c) { *p++ = c; }
+        void append(const char *s, size_t n) {
+            if (p != s) {
+                memmove(p, s, n);
+            }
+            p += n;
+        }
+    };
+
+    void parse() {
+        skip_space();
+
+        if (current_ == Empty) {
+            next_.type = Empty;
+            return;
+        }
+
+        switch (current_) {
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',':
+                next_.type = current_;
+                read();
+                break;
+            case '"':
+                next_.type = String;
+                break;
+            case 'n':
+                next_.type = match("null") ? Null : Error;
+                break;
+            case 't':
+                next_.bval = true;
+                next_.type = match("true") ? Bool : Error;
+                break;
+            case 'f':
+                next_.bval = false;
+                next_.type = match("false") ? Bool : Error;
+                break;
+            default:
+                next_.type = parse_num(next_);
+                break;
+        }
+    }
+
+    // Matches a literal starting at current_ and reads the character after it. Compares the
+    // whole literal at once when it is in the buffer.
+    template <size_t N>
+    bool match(const char (&literal)[N]) {
+        constexpr size_t len = N - 1;
+        if (size_ >= len - 1) {
+            if (memcmp(data_ - 1, literal, len) != 0) {
+                return false;
+            }
+            data_ += len - 1;
+            size_ -= len - 1;
+            read();
+            return true;
+        }
+        for (size_t i = 1; i < len; i++) {
+            if (read() != literal[i]) {
+                return false;
+            }
+        }
+        read();
+        return true;
+    }
+
+    void skip_space() {
+        while (is_class(current_, CharSpace)) {
+            const char *p = find_non_space(data_, data_ + size_);
+            size_ -= p - data_;
+            data_ = p;
+            read();
+        }
+    }
+
+    // Moves data_ to the next quote, backslash or control character in the buffer.
+    void skip_plain_chars() {
+        const char *p = find_string_special(data_, data_ + size_);
+        size_ -= p - data_;
+        data_ = p;
+    }
+
+    bool skip_string() {
+        for (;;) {
+            skip_plain_chars();
+            switch (read()) {
+                case '"':
+                    read();
+                    return true;
+                case '\\':
+                    read();
+                    break;
+                case Empty:
+                    return false;
+                default:
+                    if (current_ >= 0 && current_ < 0x20) {
+                        return false;
+                    }
+                    break;
+            }
+        }
+    }
+
+    template <class Out>
+    int parse_hex(Out &s) {
+        char data[4];
+        data[0] = read();
+        data[1] = read();
+        data[2] = read();
+        data[3] = read();
+        int cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = data[i];
+            cp *= 16;
+            if (c >= '0' && c <= '9')
+                cp += c - '0';
+            else if (c >= 'a' && c <= 'f')
+                cp += c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                cp += c - 'A' + 10;
+            else
+                return Error;
+        }
+        int n = encode_utf8(cp, data);
+        for (int i = 0; i < n; i++) {
+            s.push_back(data[i]);
+        }
+        return String;
+    }
+
+    int parse_num(Token &val) {
+        const char *begin = data_ - 1;
+        const char *end = data_ + size_;
+        const char *p = begin;
+        while (p < end && is_number_char(*p)) {
+            p++;
+        }
+
+        if (p < end || stable_) {
+            size_ = end - p;
+            data_ = p;
+            read();
+            val.text = std::string_view(begin, p - begin);
+            return to_number(begin, p, val);
+        }
+
+        // The number may continue in the next block.
+        num_.assign(begin, p);
+        size_ = 0;
+        data_ = p;
+        while (is_number_char(read())) {
+            num_.push_back(current_);
+        }
+        val.text = num_;
+        return to_number(num_.data(), num_.data() + num_.size(), val);
+    }
+
+    void start() {
+        read();
+        parse();
+    }
+
+    // Reads the characters of the current string into s up to and including the closing quote.
+    // Runs of plain characters are found by find_string_special() and appended in bulk.
+    template <class Out>
+    bool read_chars(Out &s) {
+        for (;;) {
+            const char *p = data_;
+            skip_plain_chars();
+            s.append(p, data_ - p);
+            switch (read()) {
+                case '"':
+                    read();
+                    parse();
+                    return true;
+                case '\\':
+                    switch (read()) {
+                        case '"':
+                            s.push_back('"');
+                            break;
+                        case '\\':
+                            s.push_back('\\');
+                            break;
+                        case '/':
+                            s.push_back('/');
+                            break;
+                        case 'b':
+                            s.push_back('\b');
+                            break;
+                        case 'f':
+                            s.push_back('\f');
+                            break;
+                        case 'n':
+                            s.push_back('\n');
+                            break;
+                        case 'r':
+                            s.push_back('\r');
+                            break;
+                        case 't':
+                            s.push_back('\t');
+                            break;
+                        case 'u':
+                            if (parse_hex(s) == Error) {
+                                return false;
+                            }
+                            break;
+                        default:
+                            return false;
+                    }
+                    break;
+                case Empty:
+                    return false;
+                default:
+                    // Either a control character or the first character of a new block.
+                    if (current_ >= 0 && current_ < 0x20) {
+                        return false;
+                    }
+                    s.push_back(current_);
+                    break;
+            }
+        }
+    }
+
+    // Returns the closing quote of the current string if it is in the buffer and has no escapes,
+    // nullptr otherwise.
+    const char *find_plain_string() const {
+        const char *end = data_ + size_;
+        const char *p = find_string_special(data_, end);
+        return p < end && *p == '"' ? p : nullptr;
+    }
+
+    void skip_plain_string(const char *quote) {
+        size_ -= quote + 1 - data_;
+        data_ = quote + 1;
+        read();
+        parse();
+    }
+
+    bool seek_key(std::string_view name) {
+        consume('{');
+        std::string_view key;
+        while (!next_is('}')) {
+            if (!read_key(key)) {
+                return false;
+            }
+            if (key == name) {
+                return true;
+            }
+            if (!skip_value() || !consume(',')) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool seek_index(std::string_view token) {
+        if (token.empty() || (token[0] == '0' && token.size() > 1)) {
+            return false;
+        }
+        size_t index = 0;
+        auto result = std::from_chars(token.data(), token.data() + token.size(), index);
+        if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+            return false;
+        }
+        consume('[');
+        for (; index > 0; index--) {
+            if (next_is(']') || !skip_value() || !consume(',')) {
+                return false;
+            }
+        }
+        return !next_is(']');
+    }
+
+    void rebind(const char *data, size_t size, bool stable) {
+        data_ = data;
+        size_ = size;
+        stable_ = stable;
+        insitu_ = false;
+        start();
+    }
+
+    // Takes over the input of other, rebasing data_ if it points into the buffer of other, and
+    // leaves other at the end of an empty input.
+    void take(Reader &other) {
+        // The text of a number token points into the buffer or into num_.
+        const char *text = other.next_.text.data();
+        bool text_in_buff = text >= other.buff_ && text <= other.buff_ + BUFF;
+        bool text_in_num = !text_in_buff && text == other.num_.data();
+
+        source_ = std::move(other.source_);
+        if (other.data_ >= other.buff_ && other.data_ <= other.buff_ + BUFF) {
+            size_t offset = other.data_ - other.buff_;
+            memcpy(buff_, other.buff_, offset + other.size_);
+            data_ = buff_ + offset;
+        } else {
+            data_ = other.data_;
+        }
+        size_ = other.size_;
+        current_ = other.current_;
+        insitu_ = other.insitu_;
+        stable_ = other.stable_;
+        next_ = other.next_;
+        key_ = std::move(other.key_);
+        scratch_ = std::move(other.scratch_);
+        num_ = std::move(other.num_);
+        resource_ = other.resource_;
+        if (text_in_buff) {
+            next_.text = std::string_view(buff_ + (text - other.buff_), next_.text.size());
+        } else if (text_in_num) {
+            next_.text = num_;
+        }
+
+        other.source_ = Source();
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.current_ = Empty;
+        other.next_.type = Empty;
+    }
+
+    template <class T, class Members, size_t... Is>
+    bool read_field(T &value, const Members &members, size_t field, std::index_sequence<Is...>) {
+        bool ok = true;
+        bool found = ((field == Is && (ok = read(value.*std::get<Is>(members)), true)) || ...);
+        return found ? ok : skip_value();
+    }
+
+   public:
+    Reader(std::istream &input) : source_{&input}, size_(0) { start(); }
+    Reader(const std::string &s) : source_(), data_(s.data()), size_(s.length()), stable_(true) { start(); }
+    Reader(const char *s, size_t len = 0) : source_(), data_(s), size_(len ? len : strlen(s)), stable_(true) {
+        start();
+    }
+    Reader(typename identity<Source>::type source) : source_(std::move(source)), size_(0) { start(); }
+
+    // Parses a mutable buffer; string views of escaped strings are unescaped into the buffer.
+    Reader(insitu_t, char *s, size_t len = 0) : Reader(s, len) { insitu_ = true; }
+
+    // A reader is movable, e.g. into a pool, but views of strings read so far are not carried.
+    Reader(Reader &&other) noexcept { take(other); }
+
+    Reader &operator=(Reader &&other) noexcept {
+        if (this != &other) {
+            take(other);
+        }
+        return *this;
+    }
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    // Rebinds the reader to new input as the matching constructor does, keeping the capacity of
+    // its key and string buffers and its memory resource.
+    void reset(std::istream &input) {
+        source_ = Source{&input};
+        rebind(nullptr, 0, false);
+    }
+
+    void reset(const std::string &s) {
+        source_ = Source();
+        rebind(s.data(), s.length(), true);
+    }
+
+    void reset(const char *s, size_t len = 0) {
+        source_ = Source();
+        rebind(s, len ? len : strlen(s), true);
+    }
+
+    void reset(typename identity<Source>::type source) {
+        source_ = std::move(source);
+        rebind(nullptr, 0, is_contiguous<Source>::value);
+    }
+
+    void reset(insitu_t, char *s, size_t len = 0) {
+        reset(s, len);
+        insitu_ = true;
+    }
+
+    // Allocates the objects of pointers read from now on from resource instead of with new, e.g.
+    // from a std::pmr::monotonic_buffer_resource released at once after the parse. Allocator-aware
+    // objects also get an allocator on resource. Pass nullptr to go back to new.
+    void set_resource(std::pmr::memory_resource *resource) { resource_ = resource; }
+
+    inline bool next_is(int type) const { return (next_.type == type); }
+
+    // The text of the next token if it is a number, valid until the token is consumed.
+    std::string_view number_text() const {
+        return next_.type == Integer || next_.type == Number ? next_.text : std::string_view();
+    }
+
+    void consume() {
+        if (next_.type == String && !skip_string()) {
+            next_.type = Error;
+            return;
+        }
+        parse();
+    }
+
+    bool consume(int type) {
+        if (next_.type == type) {
+            if (type == String && !skip_string()) {
+                next_.type = Error;
+                return false;
+            }
+            parse();
+            return true;
+        }
+        return false;
+    }
+
+    // Skips the next value. Objects and arrays are skipped by counting brackets outside strings,
+    // jumping between quotes and brackets without tokenizing what is in between, so the contents
+    // of a skipped container are not validated.
+    bool skip_value() {
+        switch (next_.type) {
+            case Null:
+            case Bool:
+            case Integer:
+            case Number:
+                parse();
+                return true;
+            case String:
+                return consume(String);
+            case '{':
+            case '[':
+                break;
+            default:
+                return false;
+        }
+
+        // The opening bracket has been read; current_ is the character after it.
+        int depth = 1;
+        for (;;) {
+            switch (current_) {
+                case '"':
+                    if (!skip_string()) {
+                        return false;
+                    }
+                    continue;
+                case '{':
+                case '[':
+                    depth++;
+                    break;
+                case '}':
+                case ']':
+                    if (--depth == 0) {
+                        read();
+                        parse();
+                        return true;
+                    }
+                    break;
+                case Empty:
+                    next_.type = Error;
+                    return false;
+            }
+            const char *p = find_nested<>(data_, data_ + size_);
+            size_ -= p - data_;
+            data_ = p;
+            read();
+        }
+    }
+
+    // Reads an array by parsing its elements on a pool of threads. For in-memory and contiguous
+    // input, a structural pre-pass finds the elements, which are parsed in tasks of about
+    // options.chunk_size bytes by calling fn(reader, element) with a Reader<> over each element;
+    // the per-task vectors are then appended to values in order. Other input is read serially,
+    // calling fn with this reader, so fn should accept either (auto &reader).
+    template <class T, class Parse>
+    bool read_parallel(std::vector<T> &values, Parse &&fn, const ParallelOptions &options = {}) {
+        if (!stable_ || !next_is('[') || current_ == Empty) {
+            return read(values, [&] {
+                values.emplace_back();
+                return fn(*this, values.back());
+            });
+        }
+
+        const char *end = data_ + size_;
+        std::vector<const char *> starts;
+        const char *close = find_elements(data_ - 1, end, starts);
+        if (!close) {
+            next_.type = Error;
+            return false;
+        }
+
+        // Element i ends at the comma before element i + 1, or at the closing bracket; a blank
+        // last element is a trailing comma or an empty array.
+        auto element_end = [&](size_t i) { return i + 1 < starts.size() ? starts[i + 1] - 1 : close; };
+        size_t count = starts.size();
+        if (find_non_space(starts.back(), close) == close) {
+            count--;
+        }
+
+        std::vector<std::pair<size_t, size_t>> tasks;
+        for (size_t i = 0; i < count;) {
+            size_t first = i;
+            while (i < count && (i == first || (size_t)(element_end(i) - starts[first]) <= options.chunk_size)) {
+                i++;
+            }
+            tasks.emplace_back(first, i);
+        }
+
+        std::vector<std::vector<T>> results(tasks.size());
+        std::atomic<bool> ok{true};
+        parallel_for(tasks.size(), parallel_threads(options, tasks.size()), [&](size_t t) {
+            for (size_t i = tasks[t].first; i < tasks[t].second && ok; i++) {
+                const char *p = find_non_space(starts[i], element_end(i));
+                if (p == element_end(i)) {
+                    ok = false;
+                    break;
+                }
+                Reader<> reader(p, element_end(i) - p);
+                results[t].emplace_back();
+                if (!fn(reader, results[t].back()) || !reader.next_is(Empty)) {
+                    ok = false;
+                }
+            }
+        });
+        if (!ok) {
+            next_.type = Error;
+            return false;
+        }
+
+        values.reserve(values.size() + count);
+        for (auto &result : results) {
+            std::move(result.begin(), result.end(), std::back_inserter(values));
+        }
+
+        size_ = end - close - 1;
+        data_ = close + 1;
+        read();
+        parse();
+        return true;
+    }
+
+    // Moves to the value at a JSON pointer (RFC 6901) such as "/items/42/price", streaming past
+    // sibling values with skip_value(). Returns false if there is no such value. On success the
+    // reader is positioned at the value, which can then be read as usual; the rest of the
+    // enclosing containers is left unread.
+    bool seek(std::string_view pointer) {
+        std::string token;
+        while (!pointer.empty()) {
+            if (pointer[0] != '/') {
+                return false;
+            }
+            size_t end = pointer.find('/', 1);
+            std::string_view raw = pointer.substr(1, end == std::string_view::npos ? end : end - 1);
+            pointer.remove_prefix(end == std::string_view::npos ? pointer.size() : end);
+
+            token.clear();
+            for (size_t i = 0; i < raw.size(); i++) {
+                if (raw[i] == '~' && i + 1 < raw.size() && (raw[i + 1] == '0' || raw[i + 1] == '1')) {
+                    token.push_back(raw[++i] == '0' ? '~' : '/');
+                } else {
+                    token.push_back(raw[i]);
+                }
+            }
+
+            if (next_is('{') ? !seek_key(token) : !(next_is('[') && seek_index(token))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool read(bool &value) {
+        if (next_.get(value)) {
+            parse();
+            return true;
+        }
+        return false;
+    }
+
+    // Reads an integer exactly; fails if it is out of the range of Type.
+    template <typename Type, std::enable_if_t<std::is_integral<Type>::value, bool> = true>
+    bool read(Type &value) {
+        if (next_.get(value)) {
+            parse();
+            return true;
+        }
+        return false;
+    }
+
+    template <typename Type, std::enable_if_t<std::is_floating_point<Type>::value, bool> = true>
+    bool read(Type &value) {
+        if (next_.get(value)) {
+            parse();
+            return true;
+        }
+        return false;
+    }
+
+    template <typename Type, std::enable_if_t<std::is_pointer<Type>::value, bool> = true>
+    bool read(Type &value, std::function<bool()> fn = {}) {
+        if (next_is(Null)) {
+            value = nullptr;
+            parse();
+            return true;
+        }
+        if (fn) {
+            return fn();
+        }
+        using T = typename std::remove_pointer<Type>::type;
+        if (resource_) {
+            std::pmr::polymorphic_allocator<T> alloc(resource_);
+            value = alloc.allocate(1);
+            alloc.construct(value);
+        } else {
+            value = new T();
+        }
+        return read(*value);
+    }
+
+    // Elements are constructed by the allocator of the vector, so with a polymorphic allocator
+    // they allocate from the same resource.
+    template <class T, class A>
+    bool read(std::vector<T, A> &values) {
+        if (!consume('[')) {
+            return false;
+        }
+        while (!next_is(']')) {
+            values.emplace_back();
+            if (!read(values.back())) {
+                return false;
+            }
+            if (!consume(',')) {
+                break;
+            }
+        }
+        return consume(']');
+    }
+
+    template <class T, class A>
+    bool read(std::vector<T, A> &values, std::function<bool()> fn) {
+        if (!consume('[')) {
+            return false;
+        }
+        while (!next_is(']')) {
+            if (!fn()) {
+                return false;
+            }
+            if (!consume(',')) {
+                break;
+            }
+        }
+        return consume(']');
+    }
+
+    bool read(std::function<bool(const std::string &)> fn) {
+        if (!consume('{')) {
+            return false;
+        }
+        while (!next_is('}')) {
+            if (!read_key(key_)) {
+                return false;
+            }
+            if (!fn(key_)) {
+                return false;
+            }
+            if (!consume(',')) {
+                break;
+            }
+        }
+        return consume('}');
+    }
+
+    // Reads an object, passing each key as a view. See read(std::string_view &) for its lifetime.
+    template <class Fn, std::enable_if_t<std::is_invocable_r<bool, Fn &, std::string_view>::value, bool> = true>
+    bool read(Fn &&fn) {
+        if (!consume('{')) {
+            return false;
+        }
+        std::string_view key;
+        while (!next_is('}')) {
+            if (!read_key(key)) {
+                return false;
+            }
+            if (!fn(key)) {
+                return false;
+            }
+            if (!consume(',')) {
+                break;
+            }
+        }
+        return consume('}');
+    }
+
+    // Reads an object whose keys are looked up in a compile-time key set. fn is called with the
+    // index of each key in the set, or KeySet<N>::npos for other keys.
+    template <size_t N, class Fn>
+    bool read(const KeySet<N> &keys, Fn &&fn) {
+        return read([&](std::string_view key) { return fn(keys.find(key)); });
+    }
+
+    // Reads a struct declared with JSRW_FIELDS. Unknown keys are skipped.
+    template <class T, std::enable_if_t<has_fields<T>::value, bool> = true>
+    bool read(T &value) {
+        static constexpr auto fields = jsrw_fields((const T *)nullptr);
+        return read(fields.keys, [&](size_t field) {
+            return read_field(value, fields.members, field,
+                              std::make_index_sequence<std::tuple_size<decltype(fields.members)>::value>());
+        });
+    }
+
+    template <class Traits, class SA, class T, class C, class A>
+    bool read(std::map<std::basic_string<char, Traits, SA>, T, C, A> &m) {
+        using Key = std::basic_string<char, Traits, SA>;
+        return read([this, &m](std::string_view key) {
+            return read(m[Key(key.data(), key.size(), typename Key::allocator_type(m.get_allocator()))]);
+        });
+    }
+
+    template <class Traits, class A>
+    bool read(std::basic_string<char, Traits, A> &s) {
+        s.clear();
+
+        if (next_.type != String) {
+            return false;
+        }
+
+        if (const char *quote = find_plain_string()) {
+            s.assign(data_, quote - data_);
+            skip_plain_string(quote);
+            return true;
+        }
+
+        return read_chars(s);
+    }
+
+    // Reads a string as it is in the input, escapes included, without copying it. Fails unless the
+    // reader is stable, or if the string is not valid.
+    bool read_raw(std::string_view &s) {
+        if (next_.type != String || !stable_) {
+            return false;
+        }
+        const char *end = data_ + size_;
+        for (const char *p = data_;;) {
+            p = find_string_special(p, end);
+            if (p == end || (*p != '\\' && *p != '"')) {
+                return false;
+            }
+            if (*p == '"') {
+                s = std::string_view(data_, p - data_);
+                skip_plain_string(p);
+                return true;
+            }
+            size_t n = end - p > 1 && p[1] == 'u' ? 6 : 2;
+            if ((size_t)(end - p) < n || !memchr("\"\\/bfnrtu", p[1], 9)) {
+                return false;
+            }
+            for (size_t i = 2; i < n; i++) {
+                char c = p[i] | 0x20;
+                if (!(c >= '0' && c <= '9') && !(c >= 'a' && c <= 'f')) {
+                    return false;
+                }
+            }
+            p += n;
+        }
+    }
+
+    // Reads a string without copying it when the input is in memory or from a contiguous source
+    // and the string has no escapes, or when the reader was created in situ: the view then points
+    // into the source buffer. Otherwise it points to storage owned by the reader and is valid until
+    // the next string is read.
+    bool read(std::string_view &s) {
+        if (next_.type != String) {
+            return false;
+        }
+
+        if (const char *quote = stable_ ? find_plain_string() : nullptr) {
+            s = std::string_view(data_, quote - data_);
+            skip_plain_string(quote);
+            return true;
+        }
+
+        if (insitu_) {
+            char *begin = const_cast<char *>(data_);
+            InSitu out{begin};
+            if (!read_chars(out)) {
+                return false;
+            }
+            s = std::string_view(begin, out.p - begin);
+            return true;
+        }
+
+        scratch_.clear();
+        if (!read_chars(scratch_)) {
+            return false;
+        }
+        s = scratch_;
+        return true;
+    }
+
+    template <class Key>
+    bool read_key(Key &key) {
+        if (next_.type != String) {
+            return false;
+        }
+
+        if (!read(key)) {
+            return false;
+        }
+
+        if (!next_is(':')) {
+            return false;
+        }
+
+        parse();
+
+        return true;
+    }
+};
+
+template <class Source, std::enable_if_t<is_source<Source>::value, bool> = true>
+Reader(Source) -> Reader<4096, Source>;
+
+// A resumable tokenizer for input that arrives in chunks of any size, such as from a non-blocking
+// socket. A token cut off at the end of a chunk is kept, so scanning resumes in the middle of a
+// string, number or literal when the next chunk arrives.
+class Tokenizer {
+   private:
+    enum State { Start, InString, InEscape, InUnicode, InNumber, InLiteral, Failed };
+
+    State state_ = Start;
+    Token token_{};
+    std::string text_;  // the part of a string or number seen so far
+    const char *literal_ = nullptr;
+    size_t matched_ = 0;
+    int32_t code_ = 0;
+    int digits_ = 0;
+
+    int fail() {
+        state_ = Failed;
+        return token_.type = Error;
+    }
+
+    int more(bool last) { return last ? fail() : Partial; }
+
+    int number(const char *p, const char *end) {
+        token_.text = std::string_view(p, end - p);
+        token_.type = to_number(p, end, token_);
+        return token_.type == Error ? fail() : token_.type;
+    }
+
+   public:
+    // The last token scanned. The contents of a String and the text of a number stay valid until
+    // the next call to next() and, if the token was not split across chunks, as long as the chunk
+    // itself.
+    const Token &token() const { return token_; }
+
+    // Scans the next token in [p, end) and advances p past it. Returns the token type, or Partial
+    // if the chunk ends before a token is complete. With last, [p, end) is the rest of the input:
+    // a number at its end is complete, a cut off string or literal is an Error, and Empty is
+    // returned when no tokens are left.
+    int next(const char *&p, const char *end, bool last = false) {
+        for (;;) {
+            switch (state_) {
+                case Start:
+                    p = find_non_space(p, end);
+                    if (p == end) {
+                        return last ? (token_.type = Empty) : Partial;
+                    }
+                    switch (*p) {
+                        case '{':
+                        case '}':
+                        case '[':
+                        case ']':
+                        case ':':
+                        case ',':
+                            return token_.type = *p++;
+                        case '"': {
+                            const char *q = find_string_special(++p, end);
+                            if (q < end && *q == '"') {
+                                token_.text = std::string_view(p, q - p);
+                                p = q + 1;
+                                return token_.type = String;
+                            }
+                            text_.clear();
+                            state_ = InString;
+                            break;
+                        }
+                        case 'n':
+                            token_.type = Null;
+                            literal_ = "null";
+                            matched_ = 0;
+                            state_ = InLiteral;
+                            break;
+                        case 't':
+                        case 'f':
+                            token_.type = Bool;
+                            token_.bval = *p == 't';
+                            literal_ = token_.bval ? "true" : "false";
+                            matched_ = 0;
+                            state_ = InLiteral;
+                            break;
+                        default: {
+                            const char *q = p;
+                            while (q < end && is_number_char(*q)) {
+                                q++;
+                            }
+                            if (q < end || last) {
+                                std::swap(p, q);
+                                return number(q, p);
+                            }
+                            text_.assign(p, q);
+                            p = q;
+                            state_ = InNumber;
+                            return Partial;
+                        }
+                    }
+                    break;
+                case InString: {
+                    const char *q = find_string_special(p, end);
+                    text_.append(p, q);
+                    p = q;
+                    if (p == end) {
+                        return more(last);
+                    }
+                    char c = *p++;
+                    if (c == '"') {
+                        state_ = Start;
+                        token_.text = text_;
+                        return token_.type = String;
+                    }
+                    if (c != '\\') {
+                        return fail();
+                    }
+                    state_ = InEscape;
+                    break;
+                }
+                case InEscape:
+                    if (p == end) {
+                        return more(last);
+                    }
+                    state_ = InString;
+                    switch (*p++) {
+                        case '"':
+                            text_.push_back('"');
+                            break;
+                        case '\\':
+                            text_.push_back('\\');
+                            break;
+                        case '/':
+                            text_.push_back('/');
+                            break;
+                        case 'b':
+                            text_.push_back('\b');
+                            break;
+                        case 'f':
+                            text_.push_back('\f');
+                            break;
+                        case 'n':
+                            text_.push_back('\n');
+                            break;
+                        case 'r':
+                            text_.push_back('\r');
+                            break;
+                        case 't':
+                            text_.push_back('\t');
+                            break;
+                        case 'u':
+                            code_ = 0;
+                            digits_ = 0;
+                            state_ = InUnicode;
+                            break;
+                        default:
+                            return fail();
+                    }
+                    break;
+                case InUnicode:
+                    for (; digits_ < 4; digits_++) {
+                        if (p == end) {
+                            return more(last);
+                        }
+                        char c = *p++;
+                        code_ *= 16;
+                        if (c >= '0' && c <= '9') {
+                            code_ += c - '0';
+                        } else if (c >= 'a' && c <= 'f') {
+                            code_ += c - 'a' + 10;
+                        } else if (c >= 'A' && c <= 'F') {
+                            code_ += c - 'A' + 10;
+                        } else {
+                            return fail();
+                        }
+                    }
+                    {
+                        char buffer[4];
+                        text_.append(buffer, encode_utf8(code_, buffer));
+                    }
+                    state_ = InString;
+                    break;
+                case InNumber:
+                    while (p < end && is_number_char(*p)) {
+                        text_.push_back(*p++);
+                    }
+                    if (p == end && !last) {
+                        return Partial;
+                    }
+                    state_ = Start;
+                    return number(text_.data(), text_.data() + text_.size());
+                case InLiteral:
+                    for (; literal_[matched_] && p < end; matched_++) {
+                        if (*p++ != literal_[matched_]) {
+                            return fail();
+                        }
+                    }
+                    if (literal_[matched_]) {
+                        return more(last);
+                    }
+                    state_ = Start;
+                    return token_.type;
+                case Failed:
+                    return Error;
+            }
+        }
+    }
+};
+
+// Events of a PushParser, which do nothing. Handlers derive from it and hide the events they
+// need; returning false stops parsing with an error.
+struct PushHandler {
+    bool begin_object() { return true; }
+    bool end_object() { return true; }
+    bool begin_array() { return true; }
+    bool end_array() { return true; }
+    bool key(std::string_view) { return true; }
+    bool value(const Token &) { return true; }  // Null, Bool, Integer, Number or String
+};
+
+// An incremental push parser. Input is fed in chunks of any size as it arrives, and the handler
+// is called for every key and value as soon as it is complete:
+//
+//     struct Handler : jsrw::PushHandler {
+//         int64_t sum = 0;
+//         bool value(const jsrw::Token &token) {
+//             int64_t n;
+//             return token.get(n) && (sum += n, true);
+//         }
+//     };
+//
+//     Handler handler;
+//     jsrw::PushParser<Handler> parser(handler);
+//     while ((n = read(fd, buff, sizeof(buff))) > 0) {
+//         if (!parser.feed(buff, n)) break;
+//     }
+//     parser.finish();
+//
+// Values are converted by Token::get() with the same rules as Reader::read(). Like consecutive
+// reads from a Reader, a sequence of top level values is accepted.
+template <class Handler>
+class PushParser {
+   private:
+    enum Expect { Value, Element, Key, Colon, Comma };
+
+    Handler &handler_;
+    Tokenizer tokenizer_;
+    std::vector<char> stack_;  // the brackets of the open containers
+    Expect expect_ = Value;
+    bool failed_ = false;
+
+    bool run(const char *p, const char *end, bool last) {
+        if (failed_) {
+            return false;
+        }
+        for (;;) {
+            int type = tokenizer_.next(p, end, last);
+            if (type == Partial || type == Empty) {
+                return true;
+            }
+            if (type == Error || !accept(type)) {
+                failed_ = true;
+                return false;
+            }
+        }
+    }
+
+    bool accept(int type) {
+        switch (expect_) {
+            case Key:
+                if (type == String) {
+                    expect_ = Colon;
+                    return handler_.key(tokenizer_.token().text);
+                }
+                return type == '}' && close(type);
+            case Colon:
+                expect_ = Value;
+                return type == ':';
+            case Comma:
+                if (type == ',') {
+                    expect_ = stack_.back() == '{' ? Key : Element;
+                    return true;
+                }
+                return close(type);
+            case Element:
+                if (type == ']') {
+                    return close(type);
+                }
+                break;
+            case Value:
+                break;
+        }
+
+        switch (type) {
+            case '{':
+                stack_.push_back('{');
+                expect_ = Key;
+                return handler_.begin_object();
+            case '[':
+                stack_.push_back('[');
+                expect_ = Element;
+                return handler_.begin_array();
+            case Null:
+            case Bool:
+            case Integer:
+            case Number:
+            case String:
+                expect_ = stack_.empty() ? Value : Comma;
+                return handler_.value(tokenizer_.token());
+            default:
+                return false;
+        }
+    }
+
+    bool close(int type) {
+        if (stack_.empty() || stack_.back() != (type == '}' ? '{' : '[')) {
+            return false;
+        }
+        stack_.pop_back();
+        expect_ = stack_.empty() ? Value : Comma;
+        return type == '}' ? handler_.end_object() : handler_.end_array();
+    }
+
+   public:
+    PushParser(Handler &handler) : handler_(handler) {}
+
+    // Parses the next chunk of input; a token cut off at its end is completed by the next chunk.
+    // Returns false on a syntax error or if the handler stopped, and from then on.
+    bool feed(const char *data, size_t size) { return run(data, data + size, false); }
+
+    bool feed(std::string_view data) { return feed(data.data(), data.size()); }
+
+    // Ends the input. Returns true if it held complete values only.
+    bool finish() { return run(nullptr, nullptr, true) && stack_.empty(); }
+
+    // Nesting depth of the value being parsed, or 0 between top level values.
+    size_t depth() const { return stack_.size(); }
+};
+
+#ifdef JSRW_COROUTINES
+// A lazily started coroutine returning T. Awaiting a task runs it and resumes the awaiter by
+// symmetric transfer when it completes, so chains of nested reads do not grow the stack.
+template <class T>
+class Task {
+   public:
+    struct promise_type {
+        T value{};
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        auto final_suspend() noexcept {
+            struct Final {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    return h.promise().continuation;
+                }
+                void await_resume() noexcept {}
+            };
+            return Final{};
+        }
+
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+   private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+   public:
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle_.promise().continuation = awaiter;
+        return handle_;
+    }
+
+    T await_resume() { return std::move(handle_.promise().value); }
+
+    // Runs a top level task until it completes or its source suspends it.
+    void start() { handle_.resume(); }
+
+    bool done() const { return handle_.done(); }
+
+    T result() { return std::move(handle_.promise().value); }
+};
+
+// A reader that suspends instead of blocking when its buffer runs out. Its source is either a
+// plain source or an asynchronous one, whose fill() returns an awaitable yielding the size:
+//
+//     Task<bool> parse(AsyncReader<Socket> &reader, Message &message) {
+//         co_return co_await reader.read(message.values);
+//     }
+//
+// The source resumes the suspended parse when the next block arrives, e.g. from an io_uring
+// completion, so many streams share a few threads. Tokens are scanned by a Tokenizer, which keeps
+// a token cut off at the end of a block. Reads convert values with the same rules as Reader.
+// Awaiting peek(), consume() or the read of a scalar only starts a coroutine, which allocates its
+// frame, when the buffer has to be refilled.
+template <class Source, size_t BUFF = 4096>
+class AsyncReader {
+   private:
+    Source source_;
+    char buff_[BUFF];
+    const char *data_ = nullptr;
+    const char *end_ = nullptr;
+    bool eof_ = false;
+    bool scanned_ = false;
+    Tokenizer tokenizer_;
+
+    // Awaits the next token and takes it with Op::finish(). All of it is done when the awaiter
+    // suspends, which resumes it at once if the token is in the buffer and otherwise after a
+    // coroutine has refilled the buffer, so nothing depends on when await_resume() is called.
+    template <class Op, class T>
+    struct Await {
+        AsyncReader *reader;
+        T result{};
+        std::optional<Task<T>> refill;
+
+        bool await_ready() { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+            if (reader->scan()) {
+                result = static_cast<Op *>(this)->finish();
+                return awaiter;
+            }
+            refill.emplace(reader->refill(static_cast<Op *>(this)));
+            return refill->await_suspend(awaiter);
+        }
+
+        T await_resume() { return refill ? refill->await_resume() : result; }
+    };
+
+    struct Peek : Await<Peek, int> {
+        int finish() { return this->reader->token().type; }
+    };
+
+    struct Consume : Await<Consume, bool> {
+        int type;
+
+        bool finish() {
+            if (this->reader->token().type != type) {
+                return false;
+            }
+            this->reader->scanned_ = false;
+            return true;
+        }
+    };
+
+    template <class Type>
+    struct Read : Await<Read<Type>, bool> {
+        Type *value;
+
+        bool finish() {
+            if (!this->reader->token().get(*value)) {
+                return false;
+            }
+            this->reader->scanned_ = false;
+            return true;
+        }
+    };
+
+    // Scans the next token if the buffer holds all of it.
+    bool scan() {
+        if (!scanned_ && tokenizer_.next(data_, end_, eof_) != Partial) {
+            scanned_ = true;
+        }
+        return scanned_;
+    }
+
+    // Refills the buffer until the next token is scanned, and takes it with op.
+    template <class Op>
+    Task<decltype(std::declval<Op &>().finish())> refill(Op *op) {
+        while (!scan()) {
+            const char *data = buff_;
+            size_t size;
+            if constexpr (std::is_convertible<decltype(source_.fill(buff_, BUFF, data)), size_t>::value) {
+                size = source_.fill(buff_, BUFF, data);
+            } else {
+                size = co_await source_.fill(buff_, BUFF, data);
+            }
+            eof_ = size == 0;
+            data_ = data;
+            end_ = data + size;
+        }
+        co_return op->finish();
+    }
+
+   public:
+    AsyncReader(Source source) : source_(std::move(source)) {}
+
+    AsyncReader(const AsyncReader &) = delete;
+    AsyncReader &operator=(const AsyncReader &) = delete;
+
+    // Returns the type of the next token, refilling the buffer as needed.
+    Peek peek() { return Peek{{this}}; }
+
+    // The next token, after peek().
+    const Token &token() const { return tokenizer_.token(); }
+
+    // Consumes the next token if it is of the given type.
+    Consume consume(int type) { return Consume{{this}, type}; }
+
+    // Reads a bool, number or string. A string_view is valid until the next read.
+    template <class Type, class = decltype(std::declval<const Token &>().get(std::declval<Type &>()))>
+    Read<Type> read(Type &value) {
+        return Read<Type>{{this}, &value};
+    }
+
+    template <class T, class A>
+    Task<bool> read(std::vector<T, A> &values) {
+        bool ok = co_await consume('[');
+        while (ok && co_await peek() != ']') {
+            values.emplace_back();
+            ok = co_await read(values.back());
+            bool comma = ok && co_await consume(',');
+            if (!comma) {
+                break;
+            }
+        }
+        co_return ok && co_await consume(']');
+    }
+
+    template <class Traits, class SA, class T, class C, class A>
+    Task<bool> read(std::map<std::basic_string<char, Traits, SA>, T, C, A> &m) {
+        bool ok = co_await consume('{');
+        while (ok && co_await peek() != '}') {
+            std::basic_string<char, Traits, SA> key(m.get_allocator());
+            ok = token().get(key);
+            scanned_ = false;
+            ok = ok && co_await consume(':') && co_await read(m[key]);
+            bool comma = ok && co_await consume(',');
+            if (!comma) {
+                break;
+            }
+        }
+        co_return ok && co_await consume('}');
+    }
+};
+#endif
+
+// Parses the non-blank lines in [p, end), one JSON value each, appending them to records.
+template <class T, class Parse>
+bool parse_lines(const char *p, const char *end, std::vector<T> &records, Parse &parse) {
+    while (p < end) {
+        const char *nl = (const char *)memchr(p, '\n', end - p);
+        const char *eol = nl ? nl : end;
+        if (find_non_space(p, eol) < eol) {
+            Reader<> reader(p, eol - p);
+            records.emplace_back();
+            if (!parse(reader, records.back()) || !reader.next_is(Empty)) {
+                return false;
+            }
+        }
+        p = nl ? nl + 1 : end;
+    }
+    return true;
+}
+
+// Parses newline-delimited JSON (JSON Lines) in memory on a pool of threads. The input is split
+// into chunks of about options.chunk_size bytes at line boundaries, and each worker parses whole
+// chunks with its own Reader by calling parse(reader, record) for every non-blank line.
+// emit(record) is called on the calling thread with each record as an rvalue, in input order if
+// options.ordered is set and in completion order of the chunks otherwise. At most a few chunks
+// per thread are held in memory at a time. Returns false, and stops early, if a line fails to
+// parse.
+//
+// For files, map them with MappedFile and pass its data() and size().
+template <class T, class Parse, class Emit>
+bool read_lines(const char *data, size_t size, Parse &&parse, Emit &&emit, const ParallelOptions &options = {}) {
+    std::vector<std::pair<const char *, const char *>> chunks;
+    for (const char *p = data, *end = data + size; p < end;) {
+        const char *q = p + std::min(std::max<size_t>(options.chunk_size, 1), (size_t)(end - p));
+        if (q < end) {
+            const char *nl = (const char *)memchr(q, '\n', end - q);
+            q = nl ? nl + 1 : end;
+        }
+        chunks.emplace_back(p, q);
+        p = q;
+    }
+
+    struct Result {
+        std::vector<T> records;
+        bool done = false;
+    };
+    std::vector<Result> results(chunks.size());
+    std::queue<size_t> finished;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable space;
+    size_t next = 0;
+    size_t emitted = 0;
+    bool failed = false;
+
+    unsigned threads = parallel_threads(options, chunks.size());
+    const size_t window = threads * 4;
+
+    auto work = [&] {
+        for (;;) {
+            size_t i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                space.wait(lock, [&] { return failed || next >= chunks.size() || next < emitted + window; });
+                if (failed || next >= chunks.size()) {
+                    return;
+                }
+                i = next++;
+            }
+            bool ok = parse_lines(chunks[i].first, chunks[i].second, results[i].records, parse);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[i].done = true;
+                finished.push(i);
+                failed = failed || !ok;
+            }
+            ready.notify_one();
+            if (!ok) {
+                space.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; i++) {
+        pool.emplace_back(work);
+    }
+
+    bool ok = true;
+    for (size_t n = 0; n < chunks.size(); n++) {
+        size_t i;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&] { return failed || (options.ordered ? results[n].done : !finished.empty()); });
+            if (failed) {
+                ok = false;
+                break;
+            }
+            if (options.ordered) {
+                i = n;
+            } else {
+                i = finished.front();
+                finished.pop();
+            }
+        }
+        for (auto &record : results[i].records) {
+            emit(std::move(record));
+        }
+        std::vector<T>().swap(results[i].records);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            emitted++;
+        }
+        space.notify_all();
+    }
+
+    for (auto &thread : pool) {
+        thread.join();
+    }
+
+    return ok;
+}
+
+// Escape sequences of the characters below 0x60 that need escaping in strings: the length of
+// the sequence followed by the sequence, or 0 for characters written as they are.
+constexpr std::array<std::array<char, 8>, 0x60> make_escapes() {
+    std::array<std::array<char, 8>, 0x60> table{};
+    const char hex[] = "0123456789abcdef";
+    for (int c = 0; c < 0x20; c++) {
+        table[c] = {6, '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+    }
+    table['\b'] = {2, '\\', 'b'};
+    table['\f'] = {2, '\\', 'f'};
+    table['\n'] = {2, '\\', 'n'};
+    table['\r'] = {2, '\\', 'r'};
+    table['\t'] = {2, '\\', 't'};
+    table['"'] = {2, '\\', '"'};
+    table['\\'] = {2, '\\', '\\'};
+    table['/'] = {2, '\\', '/'};
+    return table;
+}
+
+inline constexpr std::array<std::array<char, 8>, 0x60> escapes = make_escapes();
+
+// Escapes the string in [p, end), passing each run of characters that need no escaping to
+// out(data, size) in one piece, and each escape sequence from the table. Slashes are escaped
+// only with slash.
+template <class Out>
+void escape_string(const char *p, const char *end, bool slash, Out &&out) {
+    while (p < end) {
+        const char *q = slash ? find_string_special<true>(p, end) : find_string_special(p, end);
+        if (q > p) {
+            out(p, q - p);
+        }
+        if (q == end) {
+            break;
+        }
+        const auto &escape = escapes[(unsigned char)*q];
+        out(escape.data() + 1, escape[0]);
+        p = q + 1;
+    }
+}
+
+// Whether str escapes slashes. It is not a bool, which would make str(p, n) ambiguous.
+enum class Slash { Escape, Keep };
+
+// A string to write to a stream quoted and escaped, e.g. `os << str(s)`. Slashes are escaped
+// unless Slash::Keep is passed.
+struct str {
+    const char *s;
+    size_t len;
+    bool slash = true;
+    str(const std::string &s, Slash slash = Slash::Escape) : str(s.data(), s.length(), slash) {}
+    str(const char *s, Slash slash = Slash::Escape) : str(s, strlen(s), slash) {}
+    str(const char *s, size_t len, Slash slash = Slash::Escape) : s(s), len(len), slash(slash == Slash::Escape) {}
+};
+
+inline std::ostream &operator<<(std::ostream &os, const str &s) {
+    os.put('"');
+    escape_string(s.s, s.s + s.len, s.slash, [&os](const char *data, size_t size) { os.write(data, size); });
+    os.put('"');
+    return os;
+}
+
+// Output sinks. A sink takes the contents of a writer's buffer in large blocks:
+//
+//     void write(const char *data, size_t size);
+//
+// A default constructed sink discards its output.
+struct StreamSink {
+    std::ostream *out = nullptr;
+
+    void write(const char *data, size_t size) {
+        if (out) {
+            out->write(data, size);
         }
-        return String;
     }
+};
 
-    static int32_t encode_utf8(int32_t ch, char *buffer) {
-        if (ch <= 0x7f) {
-            buffer[0] = (char)ch;
-            return 1;
-        }
+struct StringSink {
+    std::string *out = nullptr;
 
-        if (ch <= 0x7ff) {
-            buffer[0] = (char)(0xc0 | (ch >> 6));
-            buffer[1] = (char)(0x80 | (ch & 0x03f));
-            return 2;
+    void write(const char *data, size_t size) {
+        if (out) {
+            out->append(data, size);
         }
+    }
+};
 
-        if (ch <= 0xffff) {
-            buffer[0] = (char)(0xe0 | (ch >> 12));
-            buffer[1] = (char)(0x80 | ((ch >> 6) & 0x3f));
-            buffer[2] = (char)(0x80 | (ch & 0x3f));
-            return 3;
-        }
+#ifdef JSRW_POSIX
+// A sink writing to a file descriptor with writev(). Besides blocks of a writer's buffer, which
+// are written before write() returns, it takes data by reference: long runs of strings that need
+// no escaping go to the descriptor without being copied. Referenced data is written along with
+// the next block, or once high_water bytes or IOV_MAX segments are pending, which keeps memory
+// flat for output of any size. ok() turns false when a write fails, and later output is dropped.
+class FdSink {
+   private:
+    int fd_ = -1;
+    size_t high_water_ = 0;
+    size_t pending_ = 0;
+    std::vector<iovec> iov_;
+    bool ok_ = true;
 
-        if (ch <= 0x10ffff) {
-            buffer[0] = (char)(0xf0 | (ch >> 18));
-            buffer[1] = (char)(0x80 | ((ch >> 12) & 0x3f));
-            buffer[2] = (char)(0x80 | ((ch >> 6) & 0x3f));
-            buffer[3] = (char)(0x80 | (ch & 0x3f));
-            return 4;
+    // Writes the pending segments, resuming after partial writes and interrupts.
+    void send() {
+        iovec *v = iov_.data();
+        size_t n = iov_.size();
+        while (n > 0 && ok_) {
+            ssize_t written = ::writev(fd_, v, (int)std::min<size_t>(n, IOV_MAX));
+            if (written < 0) {
+                ok_ = errno == EINTR;
+                continue;
+            }
+            size_t w = written;
+            for (; n > 0 && w >= v->iov_len; v++, n--) {
+                w -= v->iov_len;
+            }
+            if (n > 0) {
+                v->iov_base = (char *)v->iov_base + w;
+                v->iov_len -= w;
+            }
         }
+        iov_.clear();
+        pending_ = 0;
+    }
 
-        return -1;
+    void push(const char *data, size_t size) {
+        if (!iov_.empty() && (const char *)iov_.back().iov_base + iov_.back().iov_len == data) {
+            iov_.back().iov_len += size;
+        } else {
+            iov_.push_back({const_cast<char *>(data), size});
+        }
+        pending_ += size;
     }
 
-    int parse_int(long &val, bool &neg) {
-        int digits = 0;
-        if ((neg = current_ == '-') || current_ == '+') {
-            read();
+   public:
+    FdSink() = default;
+    explicit FdSink(int fd, size_t high_water = 1 << 20) : fd_(fd), high_water_(high_water) {}
+
+    FdSink(FdSink &&) = default;
+    FdSink &operator=(FdSink &&) = default;
+
+    // Queues data that stays valid until the next write().
+    void reference(const char *data, size_t size) {
+        if (size > 0 && fd_ >= 0) {
+            push(data, size);
+            if (pending_ >= high_water_ || iov_.size() >= IOV_MAX) {
+                send();
+            }
         }
-        val = 0;
-        while (isdigit(current_)) {
-            val = val * 10 + (current_ - '0');
-            read();
-            digits++;
+    }
+
+    // Writes the queued data followed by data.
+    void write(const char *data, size_t size) {
+        if (fd_ >= 0) {
+            if (size > 0) {
+                push(data, size);
+            }
+            send();
         }
-        return digits;
     }
 
-    int parse_num(Token &val) {
-        long lval;
-        bool neg;
-        int digits = parse_int(lval, neg);
+    bool ok() const { return ok_; }
+};
+#endif
 
-        double scale = 1.0;
-        double dval = lval;
-        bool is_float = false;
+template <class Sink, class = void>
+struct is_sink : std::false_type {};
 
-        if (current_ == '.') {
-            read();
-            while (isdigit(current_)) {
-                dval += (scale /= 10) * (current_ - '0');
-                digits++;
-                read();
+// A sink that takes data by reference with `void reference(const char *data, size_t size)`.
+template <class Sink, class = void>
+struct is_gathering : std::false_type {};
+
+template <class Sink>
+struct is_gathering<Sink, std::void_t<decltype(std::declval<Sink &>().reference((const char *)nullptr, size_t()))>>
+    : std::true_type {};
+
+template <class Sink>
+struct is_sink<Sink, std::void_t<decltype(std::declval<Sink &>().write((const char *)nullptr, size_t()))>>
+    : std::true_type {};
+
+// Writes values as JSON into its own buffer and hands the buffer to its sink when it is full,
+// when flush() is called and when the writer is destroyed:
+//
+//     std::string json;
+//     {
+//         jsrw::Writer writer(json);
+//         writer.write(orders);
+//     }
+//
+// Structs declared with JSRW_FIELDS are written as objects with their fields in declaration
+// order.
+template <size_t BUFF = 4096, class Sink = StreamSink>
+class Writer {
+    static_assert(BUFF >= 64, "the buffer must hold the longest number");
+
+   private:
+    Sink sink_;
+    char buff_[BUFF];
+    size_t size_ = 0;
+    size_t mark_ = 0;  // the start of the buffered output not yet handed to the sink by reference
+    bool slash_ = true;
+    unsigned depth_ = 0;
+    bool referenced_ = false;
+
+    // Strings from this length on are handed to a gathering sink by reference.
+    static constexpr size_t reference_size = 512;
+
+    // Tracks nested writes. Referenced strings are sent when the outermost write returns, so
+    // they only need to stay valid during the call.
+    struct Nested {
+        Writer &writer;
+
+        Nested(Writer &writer) : writer(writer) { writer.depth_++; }
+
+        ~Nested() {
+            if (--writer.depth_ == 0 && writer.referenced_) {
+                writer.flush();
             }
-            is_float = true;
         }
+    };
 
-        if (current_ == 'e' || current_ == 'E') {
-            read();
-            bool neg;
-            if (parse_int(lval, neg) == 0) {
-                return Error;
-            }
-            scale = neg ? 0.1 : 10.0;
-            while (lval > 0) {
-                dval *= scale;
-                lval--;
+    // Writes a string from a value being written. With a gathering sink, its long runs needing
+    // no escaping are referenced instead of copied, after the buffered output.
+    void write_stable_string(const char *s, size_t len) {
+        if constexpr (is_gathering<Sink>::value) {
+            if (len >= reference_size) {
+                Nested nested(*this);
+                put('"');
+                escape_string(s, s + len, slash_, [this](const char *data, size_t size) {
+                    if (size < reference_size) {
+                        append(data, size);
+                        return;
+                    }
+                    sink_.reference(buff_ + mark_, size_ - mark_);
+                    sink_.reference(data, size);
+                    mark_ = size_;
+                    referenced_ = true;
+                });
+                put('"');
+                return;
             }
-            is_float = true;
         }
+        write_string(s, len);
+    }
 
-        if (digits == 0) {
-            return Error;
+    // Returns room for n bytes, n <= 64, to be committed by advancing size_.
+    char *reserve(size_t n) {
+        if (BUFF - size_ < n) {
+            flush();
+        }
+        return buff_ + size_;
+    }
+
+    template <size_t, class>
+    friend class Writer;
+
+    template <class T>
+    void write_element(const T &value) {
+        write(value);
+    }
+
+    template <class K, class V>
+    void write_element(const std::pair<const K, V> &p) {
+        write_string(p.first.data(), p.first.size());
+        put(':');
+        write(p.second);
+    }
+
+    template <class Container>
+    void write_parallel(const Container &values, char open, char close, const ParallelOptions &options) {
+        size_t n = values.size();
+        unsigned threads = parallel_threads(options, n);
+        if (threads == 1) {
+            write(values);
+            return;
         }
 
-        if (!is_float) {
-            val.lval = neg ? -lval : lval;
-            return Integer;
+        // Ranges of about equal numbers of elements, several per thread to balance the load.
+        size_t tasks = std::min<size_t>(n, threads * 8);
+        std::vector<typename Container::const_iterator> bounds{values.begin()};
+        for (size_t t = 0; t < tasks; t++) {
+            bounds.push_back(std::next(bounds.back(), n * (t + 1) / tasks - n * t / tasks));
         }
 
-        val.dval = neg ? -dval : dval;
+        std::vector<std::string> pieces(tasks);
+        parallel_for(tasks, threads, [&](size_t t) {
+            Writer<4096, StringSink> writer(pieces[t]);
+            writer.set_escape_slash(slash_);
+            for (auto i = bounds[t]; i != bounds[t + 1]; ++i) {
+                if (i != bounds[0]) {
+                    writer.put(',');
+                }
+                writer.write_element(*i);
+            }
+        });
 
-        return Number;
+        Nested nested(*this);
+        put(open);
+        for (const auto &piece : pieces) {
+            if constexpr (is_gathering<Sink>::value) {
+                if (depth_ == 1 && piece.size() >= reference_size) {
+                    sink_.reference(buff_ + mark_, size_ - mark_);
+                    sink_.reference(piece.data(), piece.size());
+                    mark_ = size_;
+                    referenced_ = true;
+                    continue;
+                }
+            }
+            append(piece.data(), piece.size());
+        }
+        put(close);
     }
 
-    void start() {
-        read();
-        parse();
+    template <class T, class Keys, class Members, size_t... Is>
+    void write_fields(const T &value, const Keys &keys, const Members &members, std::index_sequence<Is...>) {
+        ((put(Is > 0 ? ',' : '{'), write_string(keys[Is].data(), keys[Is].size()), put(':'),
+          write(value.*std::get<Is>(members))),
+         ...);
     }
 
    public:
-    Reader(std::istream &input) : input_(&input), size_(0) { start(); }
-    Reader(const std::string &s) : input_(nullptr), data_(s.data()), size_(s.length()) { start(); }
-    Reader(const char *s, size_t len = 0) : input_(nullptr), data_(s), size_(len ? len : strlen(s)) { start(); }
+    Writer(std::ostream &out) : sink_{&out} {}
+    Writer(std::string &out) : sink_{&out} {}
+    Writer(typename identity<Sink>::type sink) : sink_(std::move(sink)) {}
 
-    inline bool next_is(int type) const { return (next_.type == type); }
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
 
-    void consume() {
-        if (next_.type == String) {
-            skip_string();
+    ~Writer() { flush(); }
+
+    // Whether to escape slashes, which JSON allows but does not require.
+    void set_escape_slash(bool escape) { slash_ = escape; }
+
+    Sink &sink() { return sink_; }
+
+    // Hands the buffered output to the sink.
+    void flush() {
+        if (size_ > mark_ || is_gathering<Sink>::value) {
+            sink_.write(buff_ + mark_, size_ - mark_);
         }
-        parse();
+        size_ = 0;
+        mark_ = 0;
+        referenced_ = false;
     }
 
-    bool consume(int type) {
-        if (next_.type == type) {
-            if (type == String) {
-                skip_string();
+    // Writes raw output.
+    void put(char c) {
+        *reserve(1) = c;
+        size_++;
+    }
+
+    void append(const char *data, size_t size) {
+        if (size > BUFF - size_) {
+            flush();
+            if (size >= BUFF) {
+                sink_.write(data, size);
+                return;
             }
-            parse();
-            return true;
         }
-        return false;
+        memcpy(buff_ + size_, data, size);
+        size_ += size;
     }
 
-    bool read(bool &value) {
-        if (next_.type == Bool) {
-            value = next_.bval;
-            parse();
-            return true;
-        }
-        return false;
+    // Writes a quoted string, escaping quotes, backslashes, control characters and, unless
+    // turned off with set_escape_slash(), slashes.
+    void write_string(const char *s, size_t len) {
+        put('"');
+        escape_string(s, s + len, slash_, [this](const char *data, size_t size) { append(data, size); });
+        put('"');
     }
 
-    template <typename Type, std::enable_if_t<std::is_integral<Type>::value, bool> = true>
-    bool read(Type &value) {
-        if (next_.type == Integer) {
-            value = (double)next_.lval;
-            parse();
-            return true;
+    void write(std::nullptr_t) { append("null", 4); }
+
+    void write(bool b) { b ? append("true", 4) : append("false", 5); }
+
+    // Numbers are written by std::to_chars, floating point ones in the shortest form that reads
+    // back to the same value. NaN and infinities, which JSON cannot represent, are written as
+    // null.
+    template <typename T, std::enable_if_t<std::is_arithmetic<T>::value, bool> = true>
+    void write(T t) {
+        if constexpr (std::is_floating_point<T>::value) {
+            if (!std::isfinite(t)) {
+                write(nullptr);
+                return;
+            }
         }
-        return false;
+        char *p = reserve(64);
+        size_ = std::to_chars(p, buff_ + BUFF, +t).ptr - buff_;
     }
 
-    template <typename Type, std::enable_if_t<std::is_floating_point<Type>::value, bool> = true>
-    bool read(Type &value) {
-        if (next_.type == Number) {
-            value = next_.dval;
-            parse();
-            return true;
-        } else if (next_.type == Integer) {
-            value = (Type)next_.lval;
-            parse();
-            return true;
-        }
-        return false;
+    template <class Traits, class A>
+    void write(const std::basic_string<char, Traits, A> &s) {
+        write_stable_string(s.data(), s.size());
     }
 
-    template <typename Type, std::enable_if_t<std::is_pointer<Type>::value, bool> = true>
-    bool read(Type &value, std::function<bool()> fn = {}) {
-        if (next_is(Null)) {
-            value = nullptr;
-            parse();
-            return true;
-        }
-        if (fn) {
-            return fn();
+    void write(std::string_view s) { write_stable_string(s.data(), s.size()); }
+
+    void write(const char *s) {
+        if (s == nullptr) {
+            write(nullptr);
+        } else {
+            write_stable_string(s, strlen(s));
         }
-        value = new typename std::remove_pointer<Type>::type();
-        return read(*value);
     }
 
-    template <class T>
-    bool read(std::vector<T> &values) {
-        if (!consume('[')) {
-            return false;
+    template <typename T>
+    void write(const T *p) {
+        if (p == nullptr) {
+            write(nullptr);
+        } else {
+            write(*p);
         }
-        while (!next_is(']')) {
-            values.emplace_back(T());
-            if (!read(values.back())) {
-                return false;
-            }
-            if (!consume(',')) {
-                break;
+    }
+
+    template <typename T, typename A>
+    void write(const std::vector<T, A> &v) {
+        Nested nested(*this);
+        put('[');
+        size_t i = 0;
+        for (const auto &p : v) {
+            if (i++ > 0) {
+                put(',');
             }
+            write(p);
         }
-        return consume(']');
+        put(']');
     }
 
-    template <class T>
-    bool read(std::vector<T> &values, std::function<bool()> fn) {
-        if (!consume('[')) {
-            return false;
-        }
-        while (!next_is(']')) {
-            if (!fn()) {
-                return false;
-            }
-            if (!consume(',')) {
-                break;
+    template <typename Traits, typename SA, typename T, typename C, typename A>
+    void write(const std::map<std::basic_string<char, Traits, SA>, T, C, A> &m) {
+        Nested nested(*this);
+        put('{');
+        size_t i = 0;
+        for (const auto &p : m) {
+            if (i++ > 0) {
+                put(',');
             }
+            write_string(p.first.data(), p.first.size());
+            put(':');
+            write(p.second);
         }
-        return consume(']');
+        put('}');
     }
 
-    bool read(std::function<bool(const std::string &)> fn) {
-        if (!consume('{')) {
-            return false;
+    // Writes a large vector or map like write(), with ranges of its elements serialized on a pool
+    // of threads into separate strings, which are then joined in order.
+    template <typename T, typename A>
+    void write_parallel(const std::vector<T, A> &v, const ParallelOptions &options = {}) {
+        write_parallel(v, '[', ']', options);
+    }
+
+    template <typename Traits, typename SA, typename T, typename C, typename A>
+    void write_parallel(const std::map<std::basic_string<char, Traits, SA>, T, C, A> &m,
+                        const ParallelOptions &options = {}) {
+        write_parallel(m, '{', '}', options);
+    }
+
+    template <typename T, std::enable_if_t<has_fields<T>::value, bool> = true>
+    void write(const T &value) {
+        static constexpr auto fields = jsrw_fields((const T *)nullptr);
+        constexpr size_t n = std::tuple_size<decltype(fields.members)>::value;
+        Nested nested(*this);
+        write_fields(value, fields.keys, fields.members, std::make_index_sequence<n>());
+        if constexpr (n == 0) {
+            put('{');
         }
-        while (!next_is('}')) {
-            if (!read_key(key_)) {
-                return false;
-            }
-            if (!fn(key_)) {
-                return false;
-            }
-            if (!consume(',')) {
-                break;
+        put('}');
+    }
+};
+
+template <class Sink,
+          std::enable_if_t<is_sink<Sink>::value && !std::is_convertible<Sink &, std::ostream &>::value, bool> = true>
+Writer(Sink) -> Writer<4096, Sink>;
+
+Writer(std::string &) -> Writer<4096, StringSink>;
+
+// Writes a value to a stream as JSON.
+template <typename T>
+void write(std::ostream &out, const T &value) {
+    Writer<> writer(out);
+    writer.write(value);
+}
+
+// Writes JSON records from many threads as lines of NDJSON. Each thread serializes its records
+// into its own buffers, and completed records are pushed onto a lock-free queue, from which one
+// flusher thread takes all pending records at once and writes them to the sink in one batch, by
+// reference if the sink gathers:
+//
+//     jsrw::LogWriter<jsrw::FdSink> log(jsrw::FdSink(fd));
+//     ...
+//     log.write(event);  // from any thread
+//
+// A mutex and condition variable are only used to wake the flusher when it went idle. Written
+// records are returned to a lock-free free list, which a thread takes whole into its own cache
+// when it runs out of records, so that once warmed up write() does not allocate. The destructor
+// writes the pending records and stops the flusher; records must not be written concurrently
+// with it.
+template <class Sink = StreamSink>
+class LogWriter {
+   private:
+    struct Record {
+        std::string text;
+        Record *next = nullptr;
+    };
+
+    // The records a thread took for reuse, shared by the log writers of the same sink type.
+    struct Cache {
+        Record *records = nullptr;
+
+        ~Cache() {
+            while (records) {
+                delete std::exchange(records, records->next);
             }
         }
-        return consume('}');
+    };
+
+    static Cache &cache() {
+        thread_local Cache cache;
+        return cache;
     }
 
-    template <class T>
-    bool read(std::map<std::string, T> &m) {
-        return read([this, &m](const std::string &key) { return read(m[key]); });
+    // Records whose text outgrew this many bytes are not reused as they are.
+    static constexpr size_t max_record = 64 * 1024;
+
+    Sink sink_;
+    std::atomic<Record *> head_{nullptr};  // the most recent record
+    std::atomic<Record *> free_{nullptr};  // written records, only taken all at once
+    std::atomic<bool> idle_{false};
+    std::atomic<bool> stop_{false};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::string batch_;
+    std::thread flusher_;
+
+    void push(Record *record) {
+        record->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(record->next, record)) {
+        }
+        if (idle_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_.notify_one();
+        }
     }
 
-    bool read(std::string &s) {
-        s.clear();
+    void run() {
+        for (;;) {
+            Record *head = head_.exchange(nullptr);
+            if (head == nullptr) {
+                if (stop_) {
+                    break;
+                }
+                std::unique_lock<std::mutex> lock(mutex_);
+                idle_ = true;
+                wake_.wait(lock, [this] { return head_.load() != nullptr || stop_; });
+                idle_ = false;
+                continue;
+            }
 
-        while (current_ != Empty) {
-            read();
-            if (current_ == '"') {
-                read();
-                parse();
-                return true;
-            } else if (current_ == '\\') {
-                read();
-                switch (current_) {
-                    case '"':
-                        s.push_back('"');
-                        break;
-                    case '\\':
-                        s.push_back('\\');
-                        break;
-                    case '/':
-                        s.push_back('/');
-                        break;
-                    case 'b':
-                        s.push_back('\b');
-                        break;
-                    case 'f':
-                        s.push_back('\f');
-                        break;
-                    case 'n':
-                        s.push_back('\n');
-                        break;
-                    case 'r':
-                        s.push_back('\r');
-                        break;
-                    case 't':
-                        s.push_back('\t');
-                        break;
-                    case 'u':
-                        if (parse_hex(s) == Error) {
-                            return false;
-                        }
-                        break;
-                    default:
-                        return false;
+            // The queue holds the records newest first.
+            Record *records = nullptr;
+            while (head) {
+                Record *next = head->next;
+                head->next = records;
+                records = head;
+                head = next;
+            }
+            Record *last = nullptr;
+            for (Record *r = records; r; r = r->next) {
+                if constexpr (is_gathering<Sink>::value) {
+                    sink_.reference(r->text.data(), r->text.size());
+                } else {
+                    batch_ += r->text;
                 }
-            } else {
-                s.push_back(current_);
+                last = r;
+            }
+            sink_.write(batch_.data(), batch_.size());
+            batch_.clear();
+
+            // Recycle the records, keeping their storage unless a huge line grew it.
+            for (Record *r = records; r; r = r->next) {
+                if (r->text.capacity() > max_record) {
+                    std::string().swap(r->text);
+                }
+                r->text.clear();
+            }
+            last->next = free_.load(std::memory_order_relaxed);
+            while (!free_.compare_exchange_weak(last->next, records)) {
             }
         }
+    }
 
-        return false;
+   public:
+    LogWriter(std::ostream &out) : LogWriter(Sink{&out}) {}
+    LogWriter(typename identity<Sink>::type sink) : sink_(std::move(sink)) {
+        flusher_ = std::thread([this] { run(); });
     }
 
-    bool read_key(std::string &key) {
-        if (next_.type != String) {
-            return false;
-        }
+    LogWriter(const LogWriter &) = delete;
+    LogWriter &operator=(const LogWriter &) = delete;
 
-        if (!read(key)) {
-            return false;
+    ~LogWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
         }
-
-        if (!next_is(':')) {
-            return false;
+        wake_.notify_one();
+        flusher_.join();
+        for (Record *r = free_.load(); r;) {
+            delete std::exchange(r, r->next);
         }
+    }
 
-        parse();
-
-        return true;
+    // Writes a value as one line.
+    template <class T>
+    void write(const T &value) {
+        Cache &cache = this->cache();
+        if (cache.records == nullptr) {
+            cache.records = free_.exchange(nullptr);
+        }
+        Record *record = cache.records ? std::exchange(cache.records, cache.records->next) : new Record;
+        {
+            Writer<512, StringSink> writer(record->text);
+            writer.write(value);
+            writer.put('\n');
+        }
+        push(record);
     }
 };
 
-struct str {
-    const char *s;
-    size_t len;
-    str(const std::string &s) : str(s.data(), s.length()) {}
-    str(const char *s) : str(s, strlen(s)) {}
-    str(const char *s, size_t len) : s(s), len(len) {}
+template <class Sink,
+          std::enable_if_t<is_sink<Sink>::value && !std::is_convertible<Sink &, std::ostream &>::value, bool> = true>
+LogWriter(Sink) -> LogWriter<Sink>;
+
+// Options for transcode().
+struct TranscodeOptions {
+    unsigned indent = 0;  // spaces per level when pretty-printing, 0 to minify
 };
 
-inline std::ostream &operator<<(std::ostream &os, const str &s) {
-    const char *p = s.s;
-    const char *q = s.s + s.len;
+// Copies the next value from a reader to a writer token by token, without building it in
+// memory, so memory use depends only on the nesting depth. The output is minified, or
+// pretty-printed with options.indent. Numbers are copied as they are in the input, and so are
+// strings from stable readers; other strings and keys are unescaped and escaped again, leaving
+// slashes as they are. keep(key) is called with a std::string_view & for every object key: it
+// returns false to drop the member, or may point the key at a new name that stays valid until the
+// next call.
+template <size_t RB, class Source, size_t WB, class Sink, class Keep>
+bool transcode(Reader<RB, Source> &reader, Writer<WB, Sink> &writer, const TranscodeOptions &options, Keep &&keep) {
+    static const char spaces[] = "                                                                ";
 
-    os << '"';
+    struct Level {
+        char close;
+        bool first;    // no member or element read yet
+        bool written;  // some member or element written
+    };
+    std::vector<Level> levels;
 
-    for (char c = *p; p < q; c = *++p) {
-        switch (c) {
-            case '\"':
-                os << "\\\"";
-                break;
-            case '\\':
-                os << "\\\\";
-                break;
-            case '/':
-                os << "\\/";
-                break;
-            case '\b':
-                os << "\\b";
-                break;
-            case '\f':
-                os << "\\f";
-                break;
-            case '\n':
-                os << "\\n";
-                break;
-            case '\r':
-                os << "\\r";
-                break;
-            case '\t':
-                os << "\\t";
-                break;
-            default:
-                if (c >= 0 && c <= 0x1F) {
-                    char buf[8];
-                    snprintf(buf, sizeof(buf), "\\u%04x", c);
-                    os << buf;
-                } else {
-                    os << c;
+    auto newline = [&](size_t depth) {
+        if (options.indent) {
+            writer.put('\n');
+            for (size_t n = depth * options.indent; n > 0;) {
+                size_t k = std::min(n, sizeof(spaces) - 1);
+                writer.append(spaces, k);
+                n -= k;
+            }
+        }
+    };
+
+    auto write_string = [&](std::string_view s) {
+        writer.put('"');
+        escape_string(s.data(), s.data() + s.size(), false, [&](const char *data, size_t size) {
+            writer.append(data, size);
+        });
+        writer.put('"');
+    };
+
+    for (;;) {
+        std::string_view s;
+        bool b;
+        if (reader.next_is('{') || reader.next_is('[')) {
+            char open = reader.next_is('{') ? '{' : '[';
+            reader.consume(open);
+            writer.put(open);
+            levels.push_back({open == '{' ? '}' : ']', true, false});
+        } else if (reader.next_is(Integer) || reader.next_is(Number)) {
+            s = reader.number_text();
+            writer.append(s.data(), s.size());
+            reader.consume();
+        } else if (reader.read_raw(s)) {
+            writer.put('"');
+            writer.append(s.data(), s.size());
+            writer.put('"');
+        } else if (reader.next_is(String)) {
+            if (!reader.read(s)) {
+                return false;
+            }
+            write_string(s);
+        } else if (reader.read(b)) {
+            writer.write(b);
+        } else if (reader.consume(Null)) {
+            writer.write(nullptr);
+        } else {
+            return false;
+        }
+
+        // Moves to the next member or element, closing the containers that end.
+        for (;;) {
+            if (levels.empty()) {
+                return true;
+            }
+            Level &level = levels.back();
+            bool more = level.first || reader.consume(',');
+            if (!more || reader.next_is(level.close)) {
+                if (!reader.consume(level.close)) {
+                    return false;
                 }
-                break;
+                if (level.written) {
+                    newline(levels.size() - 1);
+                }
+                writer.put(level.close);
+                levels.pop_back();
+                continue;
+            }
+            level.first = false;
+
+            if (level.close == '}') {
+                std::string_view key;
+                if (!reader.read_key(key)) {
+                    return false;
+                }
+                if (!keep(key)) {
+                    if (!reader.skip_value()) {
+                        return false;
+                    }
+                    continue;
+                }
+                if (level.written) {
+                    writer.put(',');
+                }
+                newline(levels.size());
+                write_string(key);
+                writer.put(':');
+                if (options.indent) {
+                    writer.put(' ');
+                }
+            } else {
+                if (level.written) {
+                    writer.put(',');
+                }
+                newline(levels.size());
+            }
+            level.written = true;
+            break;
         }
     }
+}
 
-    os << '"';
-
-    return os;
+template <size_t RB, class Source, size_t WB, class Sink>
+bool transcode(Reader<RB, Source> &reader, Writer<WB, Sink> &writer, const TranscodeOptions &options = {}) {
+    return transcode(reader, writer, options, [](std::string_view &) { return true; });
 }
 
 }  // namespace jsrw
+
+// Declares the fields of a struct for reading and writing, at namespace scope after the struct:
+//
+//     struct Order {
+//         int id;
+//         std::vector<OrderItem> items;
+//     };
+//     JSRW_FIELDS(Order, id, items)
+//
+// Keys are the field names. The generated readers and writers are statically dispatched.
+#define JSRW_FIELDS(Type, ...)                                                           \
+    constexpr auto jsrw_fields(const Type *) {                                           \
+        return ::jsrw::make_fields(JSRW_MAP_LIST_UD(JSRW_FIELD_, Type, __VA_ARGS__)); \
+    }
+
+#define JSRW_FIELD_(name, Type) ::jsrw::field(#name, &Type::name)
+
+// Applies f(x, userdata) to each argument, separated by commas.
+#define JSRW_EVAL0(...) __VA_ARGS__
+#define JSRW_EVAL1(...) JSRW_EVAL0(JSRW_EVAL0(JSRW_EVAL0(__VA_ARGS__)))
+#define JSRW_EVAL2(...) JSRW_EVAL1(JSRW_EVAL1(JSRW_EVAL1(__VA_ARGS__)))
+#define JSRW_EVAL3(...) JSRW_EVAL2(JSRW_EVAL2(JSRW_EVAL2(__VA_ARGS__)))
+#define JSRW_EVAL4(...) JSRW_EVAL3(JSRW_EVAL3(JSRW_EVAL3(__VA_ARGS__)))
+#define JSRW_EVAL(...) JSRW_EVAL4(JSRW_EVAL4(JSRW_EVAL4(__VA_ARGS__)))
+#define JSRW_MAP_END(...)
+#define JSRW_MAP_OUT
+#define JSRW_MAP_COMMA ,
+#define JSRW_MAP_GET_END2() 0, JSRW_MAP_END
+#define JSRW_MAP_GET_END1(...) JSRW_MAP_GET_END2
+#define JSRW_MAP_GET_END(...) JSRW_MAP_GET_END1
+#define JSRW_MAP_NEXT0(test, next, ...) next JSRW_MAP_OUT
+#define JSRW_MAP_LIST_NEXT1(test, next) JSRW_MAP_NEXT0(test, JSRW_MAP_COMMA next, 0)
+#define JSRW_MAP_LIST_NEXT(test, next) JSRW_MAP_LIST_NEXT1(JSRW_MAP_GET_END test, next)
+#define JSRW_MAP_LIST_UD0(f, userdata, x, peek, ...) \
+    f(x, userdata) JSRW_MAP_LIST_NEXT(peek, JSRW_MAP_LIST_UD1)(f, userdata, peek, __VA_ARGS__)
+#define JSRW_MAP_LIST_UD1(f, userdata, x, peek, ...) \
+    f(x, userdata) JSRW_MAP_LIST_NEXT(peek, JSRW_MAP_LIST_UD0)(f, userdata, peek, __VA_ARGS__)
+#define JSRW_MAP_LIST_UD(f, userdata, ...) \
+    JSRW_EVAL(JSRW_MAP_LIST_UD1(f, userdata, __VA_ARGS__, ()()(), ()()(), ()()(), 0))
@@ -1,6 +1,10 @@
 #include <assert.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <sstream>
 
 #include "jsrw.h"
@@ -54,6 +58,39 @@ static void test_read_bool() {
     assert(reader.next_is(Empty));
 }
 
+static void test_read_literals() {
+    const char *json = "[true,\n    false,\r\n\t                                   null , truex]";
+    auto check = [](auto &reader) {
+        bool b;
+        assert(reader.consume('['));
+        assert(reader.read(b) && b);
+        assert(reader.consume(','));
+        assert(reader.read(b) && !b);
+        assert(reader.consume(','));
+        assert(reader.consume(Null));
+        assert(reader.consume(','));
+        assert(reader.read(b) && b);
+        assert(reader.next_is(Error));
+    };
+    {
+        std::istringstream input(json);
+        Reader<3> reader(input);
+        check(reader);
+    }
+    {
+        Reader reader(json);
+        check(reader);
+    }
+    {
+        Reader reader("\v1");
+        assert(reader.next_is(Error));
+    }
+    {
+        Reader reader("nul");
+        assert(reader.next_is(Error));
+    }
+}
+
 static void test_read_number() {
     {
         std::istringstream input("123 -456 0 -0,");
@@ -198,6 +235,80 @@ static void test_read_number() {
     }
 }
 
+static void test_read_float() {
+    auto parse = [](const char *s, double &val) {
+        Reader reader(s);
+        return reader.read(val) && reader.next_is(Empty);
+    };
+    double val;
+    assert(parse("0.1", val) && val == 0.1);
+    assert(parse("-0.3", val) && val == -0.3);
+    assert(parse("1e300", val) && val == 1e300);
+    assert(parse("2.2250738585072014e-308", val) && val == 2.2250738585072014e-308);
+    assert(parse("9007199254740993.0", val) && val == 9007199254740992.0);
+    assert(parse("123456789.123456789e-5", val) && val == 1234.56789123456789);
+    assert(parse("1e-999999999", val) && val == 0);
+    assert(parse("0.0001e-999999999999", val) && val == 0);
+    assert(!parse("1e999999999", val));
+    assert(!parse("0.001e400", val));
+    assert(parse("0.001e300", val) && val == 1e297);
+    assert(!parse("1e", val));
+    assert(!parse("1.2.3", val));
+    assert(!parse("--1", val));
+
+    // numbers split across buffer refills
+    std::istringstream input("[3.14159265358979, 1e-7, 123]");
+    Reader<3> reader(input);
+    std::vector<double> values;
+    assert(reader.read(values));
+    assert(values == std::vector<double>({3.14159265358979, 1e-7, 123}));
+}
+
+static void test_read_integer() {
+    {
+        Reader reader("18446744073709551615 9223372036854775807 -9223372036854775808 9007199254740993");
+        uint64_t u64;
+        int64_t i64;
+        assert(reader.read(u64) && u64 == UINT64_MAX);
+        assert(reader.read(i64) && i64 == INT64_MAX);
+        assert(reader.read(i64) && i64 == INT64_MIN);
+        assert(reader.read(i64) && i64 == 9007199254740993);
+    }
+    {
+        Reader reader("18446744073709551616");
+        uint64_t u64;
+        assert(reader.next_is(Number));
+        assert(!reader.read(u64));
+        double d;
+        assert(reader.read(d) && d == 18446744073709551616.0);
+    }
+    {
+        Reader reader("-9223372036854775809 -1 128 -129 -128 255 -0");
+        int64_t i64;
+        unsigned u;
+        int8_t i8;
+        uint8_t u8;
+        assert(!reader.read(i64));
+        reader.consume();
+        assert(!reader.read(u));
+        reader.consume();
+        assert(!reader.read(i8));
+        reader.consume();
+        assert(!reader.read(i8));
+        reader.consume();
+        assert(reader.read(i8) && i8 == -128);
+        assert(reader.read(u8) && u8 == 255);
+        assert(reader.read(u) && u == 0);
+    }
+    {
+        std::istringstream input("[1234567890123456789, 12345678, 1234567, 00000000001]");
+        Reader<4> reader(input);
+        std::vector<long long> values;
+        assert(reader.read(values));
+        assert(values == std::vector<long long>({1234567890123456789, 12345678, 1234567, 1}));
+    }
+}
+
 static void test_read_string() {
     std::string s;
     {
@@ -256,6 +367,173 @@ static void test_read_string() {
     }
 }
 
+static void test_read_string_view() {
+    std::string_view sv;
+    {
+        std::string input = "[\"hello\", \"a\\nb\"]";
+        Reader reader(input);
+        assert(reader.consume('['));
+        assert(reader.read(sv));
+        assert(sv == "hello");
+        assert(sv.data() == input.data() + 2);
+        assert(reader.consume(','));
+        assert(reader.read(sv));
+        assert(sv == "a\nb");
+        assert(reader.consume(']'));
+    }
+    {
+        char input[] = "{\"k\\u597d\": \"x\\\"y\", \"z\": \"\"}";
+        Reader reader(insitu, input);
+        std::vector<std::string_view> views;
+        bool ok = reader.read([&](std::string_view key) {
+            views.push_back(key);
+            std::string_view value;
+            bool ok = reader.read(value);
+            views.push_back(value);
+            return ok;
+        });
+        assert(ok);
+        assert(views == std::vector<std::string_view>({"k好", "x\"y", "z", ""}));
+        assert(views[0].data() == input + 2);
+        assert(views[1].data() == input + 13);
+    }
+    {
+        std::istringstream input("\"a\\tb\" \"c\"");
+        Reader<2> reader(input);
+        assert(reader.read(sv));
+        assert(sv == "a\tb");
+        assert(reader.read(sv));
+        assert(sv == "c");
+        assert(!reader.read(sv));
+    }
+}
+
+static void test_read_sources() {
+    const char json[] = "{\"x\": [1, 2], \"y\": \"abc\"}";
+    auto check = [](auto &reader) {
+        std::vector<int> x;
+        std::string y;
+        bool ok = reader.read([&](const std::string &key) { return key == "x" ? reader.read(x) : reader.read(y); });
+        return ok && x == std::vector<int>({1, 2}) && y == "abc" && reader.next_is(Empty);
+    };
+    {
+        Reader reader(MemorySource{json, sizeof(json) - 1});
+        assert(check(reader));
+    }
+    {
+        FILE *file = tmpfile();
+        fwrite(json, 1, sizeof(json) - 1, file);
+        rewind(file);
+        Reader<3, FileSource> reader(FileSource{file});
+        assert(check(reader));
+        fclose(file);
+    }
+    {
+        int fds[2];
+        assert(pipe(fds) == 0);
+        assert(write(fds[1], json, sizeof(json) - 1) == sizeof(json) - 1);
+        close(fds[1]);
+        Reader reader(FdSource{fds[0]});
+        assert(check(reader));
+        close(fds[0]);
+    }
+    {
+        Reader<16, FdSource> reader("[1]");
+        std::vector<int> values;
+        assert(reader.read(values));
+        assert(values == std::vector<int>({1}));
+    }
+}
+
+static void test_read_mapped_file() {
+    char path[] = "/tmp/jsrw_testXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    const char json[] = "{\"name\": \"mapped\", \"values\": [1, 2, 3]}";
+    assert(write(fd, json, sizeof(json) - 1) == sizeof(json) - 1);
+    close(fd);
+
+    {
+        MappedFile file(path);
+        assert(file.is_open());
+        assert(file.size() == sizeof(json) - 1);
+        Reader reader(std::move(file));
+        std::string_view name;
+        std::vector<int> values;
+        bool ok = reader.read([&](std::string_view key) { return key == "name" ? reader.read(name) : reader.read(values); });
+        assert(ok);
+        assert(name == "mapped");
+        assert(values == std::vector<int>({1, 2, 3}));
+        assert(reader.next_is(Empty));
+    }
+
+    unlink(path);
+
+    {
+        Reader reader{MappedFile(path)};
+        assert(reader.next_is(Empty));
+    }
+}
+
+static void test_read_long_string() {
+    std::string text;
+    for (int i = 0; i < 200; i++) {
+        text += "abcdefghij好klmnopqrstuvwxyz"[i % 29];
+        if (i % 37 == 0) {
+            text += '\n';
+        }
+        if (i % 53 == 0) {
+            text += '"';
+        }
+    }
+    std::string json = "[\"";
+    for (char c : text) {
+        if (c == '\n') {
+            json += "\\n";
+        } else if (c == '"') {
+            json += "\\\"";
+        } else {
+            json += c;
+        }
+    }
+    json += "\", \"" + std::string(100, 'x') + "\"]";
+
+    std::vector<std::string> expected = {text, std::string(100, 'x')};
+    {
+        std::vector<std::string> values;
+        Reader reader(json);
+        assert(reader.read(values));
+        assert(values == expected);
+    }
+    {
+        std::istringstream input(json);
+        Reader<7> reader(input);
+        std::vector<std::string> values;
+        assert(reader.read(values));
+        assert(values == expected);
+    }
+    {
+        std::istringstream input(json);
+        Reader<5> reader(input);
+        assert(reader.consume('['));
+        assert(reader.consume(String));
+        assert(reader.consume(','));
+        assert(reader.consume(String));
+        assert(reader.consume(']'));
+        assert(reader.next_is(Empty));
+    }
+    {
+        std::string s;
+        Reader reader("\"abc\x01\"");
+        assert(!reader.read(s));
+    }
+    {
+        Reader reader("\"abcdefghijklmnopqrstuvwxyz\x1f\" 1");
+        reader.consume();
+        assert(reader.next_is(Error));
+    }
+}
+
 static void test_skip_string() {
     std::string s;
     {
@@ -455,6 +733,125 @@ static bool read_person(Reader<> &reader, Person &person) {
     });
 }
 
+static void test_skip_value() {
+    const char *json = R"js({"a": {"x": [1, {"y": "}]\"["}], "z": null}, "name": "person", "b": [[[]]], "c": 1.5})js";
+    auto check = [](auto &reader) {
+        Person person;
+        bool ok = reader.read([&](std::string_view key) {
+            if (key == "name") {
+                return reader.read(person.name);
+            }
+            return reader.skip_value();
+        });
+        assert(ok);
+        assert(person.name == "person");
+        assert(reader.next_is(Empty));
+    };
+    {
+        Reader reader(json);
+        check(reader);
+    }
+    {
+        std::istringstream input(json);
+        Reader<3> reader(input);
+        check(reader);
+    }
+    {
+        std::string deep = std::string(1000, '[') + std::string(1000, ']') + ",";
+        Reader reader(deep);
+        assert(reader.skip_value());
+        assert(reader.next_is(','));
+    }
+    {
+        Reader reader("[1, [2, \"]\"]");
+        assert(!reader.skip_value());
+        assert(reader.next_is(Error));
+    }
+    {
+        Reader reader("}");
+        assert(!reader.skip_value());
+    }
+}
+
+static void test_read_key_set() {
+    static constexpr auto keys = make_keys("id", "name", "items", "price", "quantity", "created_at", "updated_at",
+                                           "owner", "status", "tags", "description", "region", "zone", "version",
+                                           "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n",
+                                           "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z", "");
+    static_assert(keys.find("name") == 1);
+    static_assert(keys.find("nam") == keys.npos);
+    for (size_t i = 0; i < keys.size(); i++) {
+        assert(keys.find(keys[i]) == i);
+    }
+    assert(keys.find("zz") == keys.npos);
+    assert(keys.find("items ") == keys.npos);
+
+    Reader reader(R"js({"name": "person", "age": 10, "tags": ["x"], "n\u0061me": "escaped"})js");
+    std::vector<std::string> names;
+    std::vector<std::string> tags;
+    bool ok = reader.read(keys, [&](size_t field) {
+        switch (field) {
+            case 1:
+                names.emplace_back();
+                return reader.read(names.back());
+            case 9:
+                return reader.read(tags);
+            default:
+                assert(field == keys.npos);
+                return reader.skip_value();
+        }
+    });
+    assert(ok);
+    assert(names == std::vector<std::string>({"person", "escaped"}));
+    assert(tags == std::vector<std::string>({"x"}));
+}
+
+static void test_seek() {
+    const char *json = R"js({"metadata": {"region": "us-east", "zone": 2},
+                             "items": [{"price": 1.5}, {"price": 2.5, "tags": ["a", "b"]}],
+                             "a/b": {"m~n": true}, "": [null, 42]})js";
+    auto seek = [&](const char *pointer) {
+        std::istringstream input(json);
+        Reader<8> reader(input);
+        std::string s;
+        if (!reader.seek(pointer)) {
+            return std::string("?");
+        }
+        if (reader.next_is(String)) {
+            reader.read(s);
+        } else if (reader.next_is(Number)) {
+            double d;
+            reader.read(d);
+            s = std::to_string(d);
+        } else if (reader.next_is(Integer)) {
+            int n;
+            reader.read(n);
+            s = std::to_string(n);
+        } else if (reader.next_is(Bool)) {
+            bool b;
+            reader.read(b);
+            s = b ? "true" : "false";
+        } else {
+            s = std::string(1, reader.next_is('{') ? '{' : reader.next_is('[') ? '[' : '-');
+        }
+        return s;
+    };
+    assert(seek("") == "{");
+    assert(seek("/metadata/region") == "us-east");
+    assert(seek("/metadata/zone") == "2");
+    assert(seek("/items/1/price") == "2.500000");
+    assert(seek("/items/1/tags/1") == "b");
+    assert(seek("/items/1/tags") == "[");
+    assert(seek("/a~1b/m~0n") == "true");
+    assert(seek("//1") == "42");
+    assert(seek("/items/2") == "?");
+    assert(seek("/items/01") == "?");
+    assert(seek("/items/x") == "?");
+    assert(seek("/metadata/region/x") == "?");
+    assert(seek("/missing") == "?");
+    assert(seek("metadata") == "?");
+}
+
 static void test_parse_objects() {
     {
         std::istringstream input("{\"name\": \"person\"}");
@@ -524,91 +921,442 @@ struct Order {
     std::vector<OrderItem> items;
 };
 
-// An example JSON writer.
-class Writer {
-   public:
-    // common:
-    void write(std::ostream &out, bool b) { out << (b ? "true" : "false"); }
-
-    template <typename T>
-    void write(std::ostream &out, T t) {
-        if constexpr (std::is_pointer<T>::value) {
-            if (t == nullptr) {
-                out << "null";
-            } else {
-                write(out, *t);
-            }
-        } else {
-            out << t;
+JSRW_FIELDS(OrderItem, product_id, quantity)
+JSRW_FIELDS(Order, id, items)
+
+template <typename T>
+std::string write(const T &t) {
+    std::string s;
+    Writer writer(s);
+    writer.write(t);
+    writer.flush();
+    return s;
+}
+
+// A sink counting the blocks it is handed.
+struct CountingSink {
+    std::string *out;
+    int *blocks;
+
+    void write(const char *data, size_t size) {
+        out->append(data, size);
+        (*blocks)++;
+    }
+};
+
+static void test_writer() {
+    assert(write(std::numeric_limits<int64_t>::min()) == "-9223372036854775808");
+    assert(write(std::numeric_limits<uint64_t>::max()) == "18446744073709551615");
+    assert(write((char)65) == "65");
+    assert(write(0.5) == "0.5" && write(-1e300) == "-1e+300" && write(100.0) == "100");
+    assert(write(0.1 + 0.2) == "0.30000000000000004" && write(0.1f) == "0.1" && write(5e-324) == "5e-324");
+    assert(write(std::numeric_limits<double>::quiet_NaN()) == "null");
+    assert(write(std::vector<double>({-std::numeric_limits<double>::infinity(), 1})) == "[null,1]");
+    srand(5);
+    for (int i = 0; i < 10000; i++) {
+        uint64_t bits = (uint64_t)rand() << 42 ^ (uint64_t)rand() << 21 ^ rand();
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (std::isfinite(d)) {
+            double back;
+            assert(Reader(write(d)).read(back) && back == d);
         }
+        float f = (float)rand() / (rand() + 1);
+        assert(std::stof(write(f)) == f);
     }
+    assert(write(std::string_view("a\"b\\c/d\n\x01\x1f\xc3\xa9")) == "\"a\\\"b\\\\c\\/d\\n\\u0001\\u001f\xc3\xa9\"");
+    assert(write(nullptr) == "null");
 
-    void write(std::ostream &out, const std::string &s) { out << jsrw::str(s); }
+    // Output larger than the buffer goes to the sink in blocks.
+    std::string json;
+    int blocks = 0;
+    {
+        Writer<64, CountingSink> writer(CountingSink{&json, &blocks});
+        std::vector<std::string> values = {std::string(200, 'x'), "a\tb", std::string(50, '"')};
+        std::map<std::string, std::vector<std::string>> m = {{"k", values}};
+        writer.write(m);
+        assert(blocks > 0);
+    }
+    assert(json == "{\"k\":[\"" + std::string(200, 'x') + "\",\"a\\tb\",\"" + [] {
+        std::string s;
+        for (int i = 0; i < 50; i++) {
+            s += "\\\"";
+        }
+        return s;
+    }() + "\"]}");
 
-    void write(std::ostream &out, const char *s) {
-        if (s == nullptr) {
-            out << "null";
-        } else {
-            out << jsrw::str(s);
+    std::ostringstream os;
+    {
+        Writer writer(os);
+        std::vector<int> v(1000);
+        std::iota(v.begin(), v.end(), -500);
+        writer.write(v);
+        writer.flush();
+        std::vector<int> back;
+        assert(Reader(os.str()).read(back) && back == v);
+        writer.put(' ');
+        writer.write(true);
+    }
+    assert(os.str().substr(os.str().size() - 5) == " true");
+
+    std::vector<Order> orders(100, Order{.id = 42, .items = {{.product_id = 1, .quantity = 2}}});
+    json.clear();
+    {
+        Writer<128, StringSink> writer(StringSink{&json});
+        writer.write(orders);
+    }
+    std::vector<Order> parsed;
+    assert(Reader(json).read(parsed) && parsed.size() == 100 && parsed[99].items[0].quantity == 2);
+}
+
+// Escapes a string one character at a time.
+static std::string escape_model(const std::string &s, bool slash) {
+    std::string out = "\"";
+    for (char c : s) {
+        char buf[8];
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\b':
+                out += "\\b";
+                break;
+            case '\f':
+                out += "\\f";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (c == '/' && slash) {
+                    out += "\\/";
+                } else if (c >= 0 && c < 0x20) {
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
         }
     }
+    return out + "\"";
+}
 
-    template <typename T>
-    void write(std::ostream &out, const std::vector<T> &v) {
-        out << '[';
-        size_t i = 0;
-        for (const auto &p : v) {
-            if (i++ > 0) {
-                out << ',';
+static void test_escape_string() {
+    srand(4);
+    for (int n = 0; n < 2000; n++) {
+        std::string s;
+        for (int i = rand() % 100; i > 0; i--) {
+            s += rand() % 8 ? (char)('a' + rand() % 26) : "\"\\/\x01\x1f\n\t\xc3\xa9\x7f"[rand() % 10];
+        }
+        for (bool slash : {true, false}) {
+            std::ostringstream os;
+            os << str(s, slash ? Slash::Escape : Slash::Keep);
+            assert(os.str() == escape_model(s, slash));
+
+            std::string json;
+            {
+                Writer<64, StringSink> writer(StringSink{&json});
+                writer.set_escape_slash(slash);
+                writer.write(s);
             }
-            write(out, p);
+            assert(json == escape_model(s, slash));
+        }
+    }
+    assert(write(std::string(1000, 'a') + "/") == "\"" + std::string(1000, 'a') + "\\/\"");
+
+    // An int length picks the length, not the slash option.
+    std::ostringstream os;
+    const char *p = "a/bc";
+    int n = 3;
+    os << str(p, n) << str(p, 2, Slash::Keep);
+    assert(os.str() == "\"a\\/b\"\"a/\"");
+}
+
+static void test_fd_sink() {
+#ifdef JSRW_POSIX
+    std::vector<std::string> values;
+    for (int i = 0; i < 3000; i++) {
+        values.push_back(i % 3 == 0 ? std::string(600 + i, 'a' + i % 26) + "\n" + std::string(700, 'z')
+                                    : "short " + std::to_string(i));
+    }
+    std::map<std::string, std::vector<std::string>> m = {{"values", values}, {"more", {std::string(5000, 'm')}}};
+    std::string expected;
+    {
+        Writer writer(expected);
+        writer.write(m);
+    }
+
+    int fds[2];
+    assert(pipe(fds) == 0);
+    std::string received;
+    std::thread reader([&] {
+        char buff[1000];
+        ssize_t n;
+        while ((n = ::read(fds[0], buff, sizeof(buff))) > 0) {
+            received.append(buff, n);
         }
-        out << ']';
+    });
+    {
+        Writer<256, FdSink> writer(FdSink(fds[1], 1 << 16));
+        writer.write(m);
+        assert(writer.sink().ok());
+        // Referenced strings are sent before write() returns, so a temporary is fine.
+        writer.write(std::string(1000, 'x'));
+        writer.put('\n');
     }
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+    assert(received == expected + "\"" + std::string(1000, 'x') + "\"\n");
+
+    int fd = open("/dev/null", O_RDONLY);
+    Writer<64, FdSink> failing(FdSink{fd});
+    failing.write(values);
+    assert(!failing.sink().ok());
+    close(fd);
+#endif
+}
 
-    template <typename T>
-    void write(std::ostream &out, const std::map<std::string, T> &m) {
-        out << '{';
-        size_t i = 0;
-        for (const auto &p : m) {
-            if (i++ > 0) {
-                out << ',';
+static void test_write_parallel() {
+    std::vector<Order> orders;
+    for (int i = 0; i < 20000; i++) {
+        orders.push_back({.id = i, .items = {{.product_id = i * 7, .quantity = i % 5}}});
+    }
+    std::map<std::string, std::vector<std::string>> m;
+    for (int i = 0; i < 5000; i++) {
+        m["key/" + std::to_string(i)] = {"a\"b", std::string(i % 700, 'x')};
+    }
+    for (bool slash : {true, false}) {
+        std::string serial, parallel;
+        {
+            Writer writer(serial);
+            writer.set_escape_slash(slash);
+            writer.write(orders);
+            writer.write(m);
+            writer.write(std::vector<int>());
+        }
+        for (unsigned threads : {1, 2, 3, 8}) {
+            parallel.clear();
+            {
+                Writer writer(parallel);
+                writer.set_escape_slash(slash);
+                writer.write_parallel(orders, {.threads = threads});
+                writer.write_parallel(m, {.threads = threads});
+                writer.write_parallel(std::vector<int>(), {.threads = threads});
             }
-            out << jsrw::str(p.first);
-            out << ':';
-            write(out, p.second);
+            assert(parallel == serial);
         }
-        out << '}';
     }
 
-    // app
-    void write(std::ostream &out, const OrderItem &item) {
-        out << "{";
-        out << jsrw::str("product_id") << ":";
-        write(out, item.product_id);
-        out << ',';
-        out << jsrw::str("quantity") << ":";
-        write(out, item.quantity);
-        out << '}';
+#ifdef JSRW_POSIX
+    std::string expected;
+    {
+        Writer writer(expected);
+        writer.write(m);
+    }
+    int fds[2];
+    assert(pipe(fds) == 0);
+    std::string received;
+    std::thread reader([&] {
+        char buff[4096];
+        ssize_t n;
+        while ((n = ::read(fds[0], buff, sizeof(buff))) > 0) {
+            received.append(buff, n);
+        }
+    });
+    {
+        Writer writer(FdSink{fds[1]});
+        writer.write_parallel(m, {.threads = 4});
     }
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+    assert(received == expected);
+#endif
+}
+
+struct LogLine {
+    int thread = 0;
+    int seq = 0;
+    std::string message;
+};
 
-    void write(std::ostream &out, const Order &order) {
-        out << "{";
-        out << jsrw::str("id") << ":";
-        write(out, order.id);
-        out << ',';
-        out << jsrw::str("items") << ":";
-        write(out, order.items);
-        out << '}';
+JSRW_FIELDS(LogLine, thread, seq, message)
+
+// Counts allocations. The replacements stay out of line, so the compiler does not see free()
+// called on memory from operator new.
+static std::atomic<size_t> allocations{0};
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    allocations++;
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
     }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Counts the lines it is given.
+struct LineCounter {
+    std::atomic<size_t> *lines;
+
+    void write(const char *data, size_t size) { *lines += std::count(data, data + size, '\n'); }
 };
 
-template <typename T>
-std::string write(const T &t) {
-    std::stringstream ss;
-    Writer writer;
-    writer.write(ss, t);
-    return ss.str();
+static void test_log_writer() {
+    const int threads = 8, records = 5000;
+    std::string output;
+    {
+        LogWriter log(StringSink{&output});
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&log, t] {
+                for (int i = 0; i < records; i++) {
+                    log.write(LogLine{t, i, "event \"" + std::to_string(i) + "\""});
+                    if (i % 1000 == 0) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                }
+            });
+        }
+        for (auto &thread : pool) {
+            thread.join();
+        }
+    }
+
+    // Every record is one line, and the records of each thread are in order.
+    std::vector<int> next(threads);
+    size_t lines = 0;
+    assert(read_lines<LogLine>(
+        output.data(), output.size(), [](auto &reader, LogLine &line) { return reader.read(line); },
+        [&](LogLine &&line) {
+            assert(line.seq == next[line.thread]++ && line.message == "event \"" + std::to_string(line.seq) + "\"");
+            lines++;
+            return true;
+        },
+        {.threads = 1}));
+    assert(lines == threads * records && std::count(output.begin(), output.end(), '\n') == threads * records);
+
+    std::ostringstream os;
+    {
+        LogWriter log(os);
+        log.write(std::vector<int>{1, 2});
+        log.write(std::map<std::string, bool>{{"ok", true}});
+    }
+    assert(os.str() == "[1,2]\n{\"ok\":true}\n");
+
+    // Written records are reused: writing one at a time, at most two records are ever in use, so
+    // beyond them and their text writing does not allocate.
+    std::atomic<size_t> counted{0};
+    {
+        LogWriter log(LineCounter{&counted});
+        const std::string text(200, 'x');
+        size_t before = allocations;
+        for (size_t i = 1; i <= 1000; i++) {
+            log.write(text);
+            while (counted < i) {
+                std::this_thread::yield();
+            }
+        }
+        assert(allocations - before < 10);
+    }
+}
+
+static std::string transcode(const std::string &input, const TranscodeOptions &options = {}) {
+    std::istringstream stream(input);
+    Reader<16> reader(stream);
+    std::string output;
+    {
+        Writer<64, StringSink> writer(StringSink{&output});
+        assert(transcode(reader, writer, options) && reader.next_is(Empty));
+    }
+    return output;
+}
+
+static void test_transcode() {
+    const std::string input = " { \"a\" : [ 1.50 , -0 , 12345678901234567890123 , 1E+2 ] ,\n\t\"b\\/\\u0063\" : { } , "
+                              "\"c\" : [ ] , \"d\" : { \"e\" : [ true , false , null , \"x\\ny\" ] , } } ";
+    const std::string minified = "{\"a\":[1.50,-0,12345678901234567890123,1E+2],\"b/c\":{},\"c\":[],\"d\":{\"e\":"
+                                 "[true,false,null,\"x\\ny\"]}}";
+    assert(transcode(input) == minified);
+    assert(transcode(minified) == minified);
+
+    const std::string pretty = transcode(input, {.indent = 2});
+    assert(pretty == R"({
+  "a": [
+    1.50,
+    -0,
+    12345678901234567890123,
+    1E+2
+  ],
+  "b/c": {},
+  "c": [],
+  "d": {
+    "e": [
+      true,
+      false,
+      null,
+      "x\ny"
+    ]
+  }
+})");
+    assert(transcode(pretty) == minified);
+    assert(transcode("[[[[[]]]]]", {.indent = 40}) == "[\n" + std::string(40, ' ') + "[\n" + std::string(80, ' ') +
+                                                         "[\n" + std::string(120, ' ') + "[\n" +
+                                                         std::string(160, ' ') + "[]\n" + std::string(120, ' ') +
+                                                         "]\n" + std::string(80, ' ') + "]\n" + std::string(40, ' ') +
+                                                         "]\n]");
+
+    // Keys are dropped or renamed on the way.
+    std::string output;
+    {
+        Reader reader(input);
+        Writer writer(output);
+        assert(transcode(reader, writer, {}, [](std::string_view &key) {
+            if (key == "a" || key == "e") {
+                return false;
+            }
+            if (key == "d") {
+                key = "renamed";
+            }
+            return true;
+        }));
+    }
+    assert(output == "{\"b/c\":{},\"c\":[],\"renamed\":{}}");
+
+    // Strings are copied as they are from stable readers, and slashes are never escaped.
+    const std::string escaped = R"({"u":"a/b","v":"x\/yé\n\"","w\/":"😀"})";
+    output.clear();
+    {
+        Reader reader(escaped);
+        Writer writer(output);
+        assert(transcode(reader, writer));
+    }
+    assert(output == R"({"u":"a/b","v":"x\/yé\n\"","w/":"😀"})");
+    assert(transcode(escaped) == R"({"u":"a/b","v":"x/yé\n\"","w/":"😀"})");
+
+    // A large document streams through small buffers.
+    std::vector<Order> orders(2000, Order{.id = 1, .items = {{.product_id = 123456789, .quantity = 7}}});
+    std::string json = write(orders);
+    assert(transcode(transcode(json, {.indent = 3})) == json);
+
+    for (const char *bad : {"[1,,2]", "{\"a\" 1}", "[1}", "{\"a\":1", "nul", "[\"\x01\"]"}) {
+        std::string out;
+        Reader reader(bad);
+        Writer writer(out);
+        assert(!transcode(reader, writer));
+    }
 }
 
 static void test_write_simple_values() {
@@ -636,11 +1384,10 @@ static void test_write_simple_values() {
 
 static void test_write_vectors() {
     std::stringstream ss;
-    Writer writer;
 
     {
         std::vector<int> values = {1, 2, 3};
-        writer.write<int>(ss, values);
+        write(ss, values);
         assert(ss.str() == "[1,2,3]");
         ss.str("");
     }
@@ -648,7 +1395,7 @@ static void test_write_vectors() {
     {
         int a = 1, b = 2;
         std::vector<int *> values = {&a, &b, nullptr};
-        writer.write<int *>(ss, values);
+        write(ss, values);
         assert(ss.str() == "[1,2,null]");
         ss.str("");
     }
@@ -656,7 +1403,7 @@ static void test_write_vectors() {
     {
         int a = 1, b = 2;
         std::vector<int *> values = {&a, &b, nullptr};
-        writer.write<int *>(ss, values);
+        write(ss, values);
         assert(ss.str() == "[1,2,null]");
         ss.str("");
     }
@@ -670,7 +1417,7 @@ static void test_write_vectors() {
                                       .id = 2,
                                       .items = {{.product_id = 3, .quantity = 300}, {.product_id = 4, .quantity = 400}},
                                   }};
-        writer.write(ss, orders);
+        write(ss, orders);
         assert(
             ss.str() ==
             R"([{"id":1,"items":[{"product_id":1,"quantity":100},{"product_id":2,"quantity":200}]},{"id":2,"items":[{"product_id":3,"quantity":300},{"product_id":4,"quantity":400}]}])");
@@ -680,11 +1427,10 @@ static void test_write_vectors() {
 
 static void test_write_maps() {
     std::stringstream ss;
-    Writer writer;
 
     {
         std::map<std::string, int> value = {{"x", 1}, {"y", 2}};
-        writer.write<int>(ss, value);
+        write(ss, value);
         assert(ss.str() == "{\"x\":1,\"y\":2}");
         ss.str("");
     }
@@ -692,7 +1438,7 @@ static void test_write_maps() {
     {
         int a = 1, b = 2;
         std::map<std::string, int *> value = {{"x", &a}, {"y", &b}};
-        writer.write<int *>(ss, value);
+        write(ss, value);
         assert(ss.str() == "{\"x\":1,\"y\":2}");
         ss.str("");
     }
@@ -700,18 +1446,520 @@ static void test_write_maps() {
     {
         int a = 1, b = 2;
         std::map<std::string, int *> value = {{"x", &a}, {"y", &b}, {"z", nullptr}};
-        writer.write<int *>(ss, value);
+        write(ss, value);
         assert(ss.str() == "{\"x\":1,\"y\":2,\"z\":null}");
         ss.str("");
     }
 }
 
+static void test_fields() {
+    {
+        Reader reader(R"js([{"id": 7, "extra": {"a": [1]}, "items": [{"product_id": 1, "quantity": 2},
+                                                                {"quantity": 4, "product_id": 3}]}, {"id": 8}])js");
+        std::vector<Order> orders;
+        assert(reader.read(orders));
+        assert(orders.size() == 2);
+        assert(orders[0].id == 7);
+        assert(orders[0].items.size() == 2);
+        assert(orders[0].items[1].product_id == 3 && orders[0].items[1].quantity == 4);
+        assert(orders[1].id == 8 && orders[1].items.empty());
+
+        std::stringstream ss;
+        jsrw::write(ss, orders);
+        assert(ss.str() ==
+               R"([{"id":7,"items":[{"product_id":1,"quantity":2},{"product_id":3,"quantity":4}]},{"id":8,"items":[]}])");
+    }
+    {
+        Reader reader(R"js({"id": "x"})js");
+        Order order;
+        assert(!reader.read(order));
+    }
+}
+
+static void test_read_lines() {
+    std::string input;
+    for (int i = 0; i < 5000; i++) {
+        input += "{\"id\": " + std::to_string(i) + ", \"items\": [{\"product_id\": " + std::to_string(i * 2) +
+                 ", \"quantity\": 1}]}\n";
+        if (i % 100 == 0) {
+            input += "  \r\n";
+        }
+    }
+    auto parse = [](Reader<> &reader, Order &order) { return reader.read(order); };
+
+    ParallelOptions options;
+    options.threads = 4;
+    options.chunk_size = 1000;
+    {
+        std::vector<int> ids;
+        bool ok = read_lines<Order>(
+            input.data(), input.size(), parse,
+            [&](Order &&order) {
+                assert(order.items.size() == 1 && order.items[0].product_id == order.id * 2);
+                ids.push_back(order.id);
+            },
+            options);
+        assert(ok);
+        assert(ids.size() == 5000);
+        for (int i = 0; i < 5000; i++) {
+            assert(ids[i] == i);
+        }
+    }
+    {
+        options.ordered = false;
+        std::vector<int> ids;
+        bool ok = read_lines<Order>(input.data(), input.size(), parse, [&](Order &&order) { ids.push_back(order.id); },
+                                    options);
+        assert(ok);
+        std::sort(ids.begin(), ids.end());
+        for (int i = 0; i < 5000; i++) {
+            assert(ids[i] == i);
+        }
+    }
+    {
+        std::string bad = input + "{\"id\": 1} {\"id\": 2}\n" + input;
+        size_t count = 0;
+        bool ok = read_lines<Order>(bad.data(), bad.size(), parse, [&](Order &&) { count++; }, options);
+        assert(!ok);
+        assert(count < 10001);
+    }
+}
+
+static void test_read_parallel() {
+    std::string input = "[";
+    for (int i = 0; i < 3000; i++) {
+        input += "{\"id\": " + std::to_string(i) + ", \"note\": \"[,]{\\\"\", \"items\": [{\"product_id\": 1, \"quantity\": " +
+                 std::to_string(i) + "}]},\n";
+    }
+    input += "] 1";
+    auto parse = [](auto &reader, Order &order) { return reader.read(order); };
+    auto check = [](const std::vector<Order> &orders) {
+        assert(orders.size() == 3000);
+        for (int i = 0; i < 3000; i++) {
+            assert(orders[i].id == i && orders[i].items.size() == 1 && orders[i].items[0].quantity == i);
+        }
+    };
+
+    ParallelOptions options;
+    options.threads = 4;
+    options.chunk_size = 4096;
+    {
+        Reader reader(input);
+        std::vector<Order> orders;
+        assert(reader.read_parallel(orders, parse, options));
+        check(orders);
+        assert(reader.next_is(Integer));
+    }
+    {
+        std::istringstream stream(input);
+        Reader reader(stream);
+        std::vector<Order> orders;
+        assert(reader.read_parallel(orders, parse, options));
+        check(orders);
+        assert(reader.next_is(Integer));
+    }
+    {
+        Reader reader("[ ]");
+        std::vector<int> values;
+        assert(reader.read_parallel(values, [](auto &reader, int &n) { return reader.read(n); }));
+        assert(values.empty());
+        assert(reader.next_is(Empty));
+    }
+    for (const char *bad : {"[1, , 2]", "[1, 2", "[1, \"x]", "[1 2]", "[1, \"x\"]"}) {
+        Reader reader(bad);
+        std::vector<int> values;
+        assert(!reader.read_parallel(values, [](auto &reader, int &n) { return reader.read(n); }, options));
+    }
+}
+
+// Records the events of a push parser as text.
+struct EventLog : PushHandler {
+    std::string log;
+
+    bool begin_object() { return log += "{", true; }
+    bool end_object() { return log += "}", true; }
+    bool begin_array() { return log += "[", true; }
+    bool end_array() { return log += "]", true; }
+    bool key(std::string_view key) { return log.append(key).append(":"), true; }
+    bool value(const Token &token) {
+        int64_t i;
+        double d;
+        bool b;
+        std::string s;
+        if (token.get(i)) {
+            log += "i" + std::to_string(i);
+        } else if (token.get(d)) {
+            log += "d" + std::to_string(d);
+        } else if (token.get(b)) {
+            log += b ? "T" : "F";
+        } else if (token.get(s)) {
+            log += "s" + s;
+        } else {
+            log += "N";
+        }
+        log += ",";
+        return true;
+    }
+};
+
+static void test_push_parser() {
+    const std::string input =
+        "{\"id\": -123456789012, \"name\": \"a\\\"b\\u00e9\\n\", \"tags\": [true, false, null, 2.5e3, \"\"],\n"
+        " \"nested\": {\"a\": [[], {}], \"long\": \"" + std::string(100, 'x') + "\"}} 42 \"tail\"";
+    const std::string expected =
+        "{id:i-123456789012,name:sa\"b\xc3\xa9\n,tags:[T,F,N,d2500.000000,s,]nested:{a:[[]{}]long:s" +
+        std::string(100, 'x') + ",}}i42,stail,";
+
+    for (size_t chunk : {input.size(), (size_t)1, (size_t)2, (size_t)3, (size_t)7}) {
+        EventLog handler;
+        PushParser<EventLog> parser(handler);
+        for (size_t i = 0; i < input.size(); i += chunk) {
+            assert(parser.feed(input.data() + i, std::min(chunk, input.size() - i)));
+        }
+        assert(parser.finish());
+        assert(handler.log == expected);
+    }
+
+    srand(2);
+    for (int n = 0; n < 100; n++) {
+        EventLog handler;
+        PushParser<EventLog> parser(handler);
+        for (size_t i = 0; i < input.size();) {
+            size_t size = std::min((size_t)rand() % 16, input.size() - i);
+            assert(parser.feed(input.data() + i, size));
+            i += size;
+        }
+        assert(parser.finish());
+        assert(handler.log == expected);
+    }
+
+    // A number at the end of a chunk is complete only when a delimiter or the end arrives.
+    {
+        EventLog handler;
+        PushParser<EventLog> parser(handler);
+        assert(parser.feed("[12"));
+        assert(handler.log == "[");
+        assert(parser.feed("34]"));
+        assert(handler.log == "[i1234,]");
+        assert(parser.feed("56"));
+        assert(handler.log == "[i1234,]");
+        assert(parser.finish());
+        assert(handler.log == "[i1234,]i56,");
+    }
+
+    // Numbers carry their text, whether or not they were split across chunks.
+    {
+        struct Texts : PushHandler {
+            std::vector<std::string> texts;
+            bool value(const Token &token) { return texts.emplace_back(token.text), true; }
+        } texts;
+        PushParser<Texts> parser(texts);
+        std::string chunk = "[\"abc\", 12";
+        assert(parser.feed(chunk));
+        chunk.assign(chunk.size(), 'x');
+        assert(parser.feed("34, -5.5]") && parser.finish());
+        assert(texts.texts == std::vector<std::string>({"abc", "1234", "-5.5"}));
+    }
+
+    for (const char *bad : {"[1,", "{\"a\" 1}", "[1}", "{1: 2}", "tru", "\"abc", "[\"\\x\"]", "[1 2]", "]", "-"}) {
+        EventLog handler;
+        PushParser<EventLog> parser(handler);
+        std::string s = bad;
+        bool ok = true;
+        for (char c : s) {
+            ok = ok && parser.feed(&c, 1);
+        }
+        assert(!(ok && parser.finish()));
+    }
+
+    // A handler stops parsing by returning false.
+    struct Stop : PushHandler {
+        bool key(std::string_view key) { return key != "stop"; }
+    } stop;
+    PushParser<Stop> parser(stop);
+    assert(parser.feed("{\"go\": 1, "));
+    assert(parser.depth() == 1);
+    assert(!parser.feed("\"stop\": 2}"));
+    assert(!parser.finish());
+}
+
+static void test_arena() {
+    static char buffer[1 << 16];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    auto in_arena = [](const void *p) { return p >= buffer && p < buffer + sizeof(buffer); };
+
+    // Nothing may fall back to the default resource.
+    std::pmr::memory_resource *fallback = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+
+    const std::string input = "{\"a long key that does not fit in place\": [\"a long string that does not fit in place\", "
+                              "\"x\\ty\"], \"b\": []} "
+                              "[[1, 2], [3]] {\"id\": 7, \"items\": [{\"product_id\": 1, \"quantity\": 2}]} [[4], null]";
+    Reader reader(input);
+    std::pmr::map<std::pmr::string, std::pmr::vector<std::pmr::string>> m(&arena);
+    assert(reader.read(m));
+    assert(m.size() == 2 && m.begin()->first == "a long key that does not fit in place");
+    const auto &strings = m.begin()->second;
+    assert(strings.size() == 2 && strings[0] == "a long string that does not fit in place" && strings[1] == "x\ty");
+    assert(in_arena(m.begin()->first.data()) && in_arena(strings.data()) && in_arena(strings[0].data()));
+    assert(m.at("b").empty());
+
+    std::pmr::vector<std::pmr::vector<int>> v(&arena);
+    assert(reader.read(v));
+    assert(v.size() == 2 && v[0].size() == 2 && v[0][1] == 2 && v[1][0] == 3 && in_arena(v[1].data()));
+
+    std::pmr::set_default_resource(fallback);
+
+    // Pointers are allocated from the resource set on the reader.
+    reader.set_resource(&arena);
+    Order *order;
+    assert(reader.read(order));
+    assert(in_arena(order) && order->id == 7 && order->items.size() == 1);
+    std::pmr::vector<int> *numbers;
+    assert(reader.consume('[') && reader.read(numbers) && reader.consume(','));
+    assert(in_arena(numbers) && in_arena(numbers->data()) && *numbers == std::pmr::vector<int>({4}));
+    int *none = &order->id;
+    assert(reader.read(none) && none == nullptr && reader.consume(']'));
+    order->~Order();
+
+    std::ostringstream os;
+    write(os, m);
+    assert(os.str() == "{\"a long key that does not fit in place\":[\"a long string that does not fit in place\","
+                       "\"x\\ty\"],\"b\":[]}");
+}
+
+static void test_reset_and_move() {
+    Reader reader("{\"a\": 1}");
+    std::map<std::string, int> m;
+    assert(reader.read(m) && m["a"] == 1);
+
+    // The same reader parses one message after another.
+    std::vector<std::string> messages;
+    for (int i = 0; i < 10; i++) {
+        messages.push_back("{\"key " + std::to_string(i) + "\": [" + std::to_string(i) + "]}");
+    }
+    for (int i = 0; i < 10; i++) {
+        std::map<std::string, std::vector<int>> values;
+        reader.reset(messages[i]);
+        assert(reader.read(values) && reader.next_is(Empty));
+        assert(values.size() == 1 && values["key " + std::to_string(i)][0] == i);
+    }
+    reader.reset("[1, 2]", 3);
+    int n;
+    assert(reader.consume('[') && reader.read(n) && n == 1 && reader.consume(',') && reader.next_is(Empty));
+
+    char buffer[] = "\"a\\nb\"";
+    reader.reset(insitu, buffer);
+    std::string_view view;
+    assert(reader.read(view) && view == "a\nb" && view.data() == buffer + 1);
+
+    std::istringstream stream("true false");
+    Reader<4> small(stream);
+    bool b;
+    assert(small.read(b) && b);
+    std::istringstream other("[3]");
+    small.reset(other);
+    std::vector<int> v;
+    assert(small.read(v) && v == std::vector<int>({3}));
+
+    Reader<4, MemorySource> memory(MemorySource{"7", 1});
+    memory.reset(MemorySource{"8", 1});
+    assert(memory.read(n) && n == 8);
+
+    // Readers are moved in the middle of a block, e.g. in and out of a pool.
+    std::vector<std::istringstream> streams;
+    for (int i = 0; i < 10; i++) {
+        streams.emplace_back("[" + std::to_string(i) + ", \"s" + std::to_string(i) + "\", 123456789]");
+    }
+    std::vector<Reader<8>> pool;
+    for (auto &s : streams) {
+        pool.emplace_back(s);
+        assert(pool.back().consume('['));
+    }
+    for (int i = 0; i < 10; i++) {
+        Reader<8> r = std::move(pool[i]);
+        assert(pool[i].next_is(Empty));
+        int x, y;
+        std::string s;
+        assert(r.read(x) && x == i && r.consume(',') && r.read(s) && s == "s" + std::to_string(i));
+        pool[i] = std::move(r);
+        assert(pool[i].consume(',') && pool[i].read(y) && y == 123456789 && pool[i].consume(']'));
+        assert(pool[i].next_is(Empty));
+    }
+
+    // The text of a number survives a move, whether it is in the buffer or spans blocks.
+    for (const char *input : {"[12345, 2]", "[1234567890123456789012345, 2]"}) {
+        std::istringstream stream(input);
+        auto from = std::make_unique<Reader<8>>(stream);
+        assert(from->consume('['));
+        std::string text = input + 1;
+        text = text.substr(0, text.find(','));
+        Reader<8> to(std::move(*from));
+        from.reset();
+        assert(to.number_text() == text);
+        assert(to.consume(Integer) || to.consume(Number));
+        assert(to.consume(',') && to.number_text() == "2");
+    }
+}
+
+#ifdef JSRW_COROUTINES
+// An asynchronous source standing in for a socket: every fill suspends until the test delivers
+// the next chunk of the stream.
+struct ChunkSource {
+    struct Stream {
+        std::string input;
+        size_t pos = 0;
+        std::coroutine_handle<> waiting;
+        char *buff = nullptr;
+        size_t size = 0;
+        size_t filled = 0;
+
+        // Copies up to max bytes into the buffer of the suspended fill and resumes the reader.
+        void deliver(size_t max) {
+            filled = std::min({max, size, input.size() - pos});
+            memcpy(buff, input.data() + pos, filled);
+            pos += filled;
+            std::exchange(waiting, nullptr).resume();
+        }
+    };
+
+    Stream *stream;
+
+    auto fill(char *buff, size_t size, const char *&) {
+        struct Awaiter {
+            Stream *stream;
+            char *buff;
+            size_t size;
+
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> h) {
+                stream->waiting = h;
+                stream->buff = buff;
+                stream->size = size;
+            }
+            size_t await_resume() { return stream->filled; }
+        };
+        return Awaiter{stream, buff, size};
+    }
+};
+
+struct Message {
+    std::map<std::string, std::vector<double>> series;
+    std::string name;
+    int64_t id = 0;
+    bool ok = false;
+};
+
+static Task<bool> parse_message(AsyncReader<ChunkSource, 16> &reader, Message &message) {
+    co_return co_await reader.consume('[') && co_await reader.read(message.series) &&
+        co_await reader.consume(',') && co_await reader.read(message.name) && co_await reader.consume(',') &&
+        co_await reader.read(message.id) && co_await reader.consume(',') && co_await reader.read(message.ok) &&
+        co_await reader.consume(']') && co_await reader.consume(Empty);
+}
+
+static Task<bool> parse_pair(AsyncReader<MemorySource> &reader, int &a, std::string &b) {
+    co_return co_await reader.consume('[') && co_await reader.read(a) && co_await reader.consume(',') &&
+        co_await reader.read(b) && co_await reader.consume(']');
+}
+
+static Task<bool> parse_numbers(AsyncReader<MemorySource> &reader, std::vector<std::vector<int>> &values) {
+    co_return co_await reader.read(values);
+}
+#endif
+
+static void test_async_reader() {
+#ifdef JSRW_COROUTINES
+    // Many parses interleaved on one thread, each suspended until its next chunk arrives.
+    const int n = 1000;
+    std::vector<ChunkSource::Stream> streams(n);
+    std::vector<std::unique_ptr<AsyncReader<ChunkSource, 16>>> readers;
+    std::vector<Message> messages(n);
+    std::vector<Task<bool>> tasks;
+    for (int i = 0; i < n; i++) {
+        streams[i].input = "[{\"a\": [1.5, -2, 3e2], \"b\\u00e9\": [], \"long\": [" + std::to_string(i) +
+                           std::string(30, '0') + "]}, \"name \\\"" + std::to_string(i) + "\\\"\", " +
+                           std::to_string(-1000000007LL * i) + ", true]";
+        readers.emplace_back(new AsyncReader<ChunkSource, 16>(ChunkSource{&streams[i]}));
+        tasks.push_back(parse_message(*readers.back(), messages[i]));
+        tasks.back().start();
+    }
+    srand(3);
+    for (bool pending = true; pending;) {
+        pending = false;
+        for (int i = 0; i < n; i++) {
+            if (streams[i].waiting) {
+                streams[i].deliver(rand() % 7 + 1);
+                pending = true;
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        assert(tasks[i].done() && tasks[i].result());
+        const Message &m = messages[i];
+        assert(m.series.size() == 3 && m.series.at("a") == std::vector<double>({1.5, -2, 300}));
+        assert(m.series.at("b\xc3\xa9").empty() && m.series.at("long")[0] == std::stod(std::to_string(i) + std::string(30, '0')));
+        assert(m.name == "name \"" + std::to_string(i) + "\"");
+        assert(m.id == -1000000007LL * i && m.ok);
+    }
+
+    // A plain source completes without suspending.
+    const char *input = "[[1, 2], [], [3]] x";
+    AsyncReader<MemorySource> reader(MemorySource{input, strlen(input)});
+    std::vector<std::vector<int>> values;
+    Task<bool> task = parse_numbers(reader, values);
+    task.start();
+    assert(task.done() && task.result());
+    assert(values == std::vector<std::vector<int>>({{1, 2}, {}, {3}}));
+
+    // Chained reads of buffered tokens take them in order.
+    const char *pair = "[42, \"x\"]";
+    AsyncReader<MemorySource> pair_reader(MemorySource{pair, strlen(pair)});
+    int a = 0;
+    std::string b;
+    Task<bool> chained = parse_pair(pair_reader, a, b);
+    chained.start();
+    assert(chained.done() && chained.result() && a == 42 && b == "x");
+
+    // Tokens in the buffer are read without starting a coroutine for each, which allocates.
+    std::string numbers = "[[0";
+    for (int i = 1; i < 1000; i++) {
+        numbers += "," + std::to_string(i);
+    }
+    numbers += "]]";
+    AsyncReader<MemorySource> buffered(MemorySource{numbers.data(), numbers.size()});
+    values.clear();
+    size_t before = allocations;
+    Task<bool> all = parse_numbers(buffered, values);
+    all.start();
+    assert(all.done() && all.result() && values.size() == 1 && values[0].size() == 1000 && values[0][999] == 999);
+    assert(allocations - before < 20);  // the vectors growing, and a few frames
+
+    // Errors fail the read.
+    ChunkSource::Stream stream;
+    stream.input = "[{\"a\": [1, true]}, \"x\", 1, true]";
+    AsyncReader<ChunkSource, 16> bad{ChunkSource{&stream}};
+    Message message;
+    Task<bool> failed = parse_message(bad, message);
+    failed.start();
+    while (stream.waiting) {
+        stream.deliver(3);
+    }
+    assert(failed.done() && !failed.result());
+#endif
+}
+
 int main() {
     test_read_empty();
     test_read_symbol();
     test_read_bool();
+    test_read_literals();
     test_read_number();
+    test_read_float();
+    test_read_integer();
     test_read_string();
+    test_read_string_view();
+    test_read_sources();
+    test_read_mapped_file();
+    test_read_long_string();
     test_skip_string();
     test_read_key();
     test_read_mix();
@@ -719,8 +1967,24 @@ int main() {
     test_read_array();
     test_read_map();
     test_parse_objects();
+    test_skip_value();
+    test_read_key_set();
+    test_seek();
 
     test_write_simple_values();
     test_write_vectors();
     test_write_maps();
+    test_writer();
+    test_escape_string();
+    test_fd_sink();
+    test_write_parallel();
+    test_log_writer();
+    test_transcode();
+    test_fields();
+    test_read_lines();
+    test_read_parallel();
+    test_arena();
+    test_reset_and_move();
+    test_push_parser();
+    test_async_reader();
 }
\ No newline at end of file